@@ -1,37 +1,336 @@
 // 桥接模式
+#include "BridgeImplementation.h"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
-
-/**
- * 定义了所有实现类的接口。它不必与抽象类的接口相匹配。实际上，
- * 这两个接口可以完全不同。通常，实现类的接口仅提供原始操作，而抽象类
- * 基于这些原始操作定义了更高级别的操作。
- */
-class Implementation {
-public:
-    virtual ~Implementation() {}
-    virtual std::string OperationImplementation() const = 0;
-};
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 /**
  * 每个具体实现类对应一个特定的平台，并使用该平台的API实现实现类接口。
  */
 class ConcreteImplementationA : public Implementation {
+    static constexpr char kResult[] = "ConcreteImplementationA: Here's the result on the platform A.\n";
+
 public:
     std::string OperationImplementation() const override
     {
-        return "ConcreteImplementationA: Here's the result on the platform A.\n";
+        return kResult;
+    }
+    /**
+     * 平台 A 原生支持批量：结果是常量，直接追加，不构造临时字符串。
+     */
+    void OperationImplementation(Span<std::string> outputs) const override
+    {
+        for (std::string& output: outputs) output.append(kResult, sizeof(kResult) - 1);
     }
 };
 
 class ConcreteImplementationB : public Implementation {
 public:
+    // 只覆盖单次版本；引入基类的批量重载，否则它会被隐藏，通过 ConcreteImplementationB 调用时无法选中。
+    using Implementation::OperationImplementation;
+
     std::string OperationImplementation() const override
     {
         return "ConcreteImplementationB: Here's the result on the platform B.\n";
     }
 };
 
+/**
+ * 基于纪元（epoch）的内存回收。读者进入临界区时在自己的槽位里登记当前纪元，离开时清零，全程不加锁也不等待；
+ * 写者替换指针后推进全局纪元，等待所有仍停留在旧纪元的读者离开，之后旧对象不可能再被任何读者访问，可以安全释放。
+ * 每个线程在每个回收域里各占一个槽位；槽位表按块增长，读者线程数没有上限。
+ */
+class EpochDomain {
+private:
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> epoch{0}; // 0 表示不在临界区
+        std::atomic<bool> used{false};
+    };
+
+    /**
+     * 槽位块只追加、不释放（直到回收域析构），因此读者持有的槽位指针始终有效。
+     */
+    struct Block {
+        static constexpr std::size_t kSlots = 64;
+        std::array<Slot, kSlots> slots;
+        std::atomic<Block*> next{nullptr};
+    };
+
+    /**
+     * 某个线程在某个回收域里的登记信息。
+     */
+    struct ThreadSlot {
+        std::uint64_t domain = 0;
+        Slot* slot = nullptr;
+        int depth = 0;
+    };
+
+    /**
+     * 线程退出时归还它在各个回收域里占用的槽位；已经析构的回收域跳过。
+     */
+    struct ThreadSlots {
+        std::vector<std::unique_ptr<ThreadSlot>> slots;
+
+        ~ThreadSlots()
+        {
+            std::lock_guard<std::mutex> lock(RegistryMutex());
+            for (const auto& local: slots) {
+                if (local->slot != nullptr && Live().count(local->domain) != 0)
+                    local->slot->used.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    std::uint64_t id_;
+    std::atomic<std::uint64_t> epoch_{1};
+    Block head_;
+
+    static std::mutex& RegistryMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+    /**
+     * 仍然存活的回收域编号。编号单调递增、从不复用，所以线程退出时不会把槽位还给同一地址上的新回收域。
+     */
+    static std::unordered_set<std::uint64_t>& Live()
+    {
+        static std::unordered_set<std::uint64_t> live;
+        return live;
+    }
+
+    Slot& AcquireSlot()
+    {
+        for (Block* block = &head_;;) {
+            for (Slot& slot: block->slots) {
+                bool expected = false;
+                if (!slot.used.load(std::memory_order_relaxed) &&
+                    slot.used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    return slot;
+            }
+            Block* next = block->next.load();
+            if (next == nullptr) {
+                auto grown = std::make_unique<Block>();
+                grown->slots[0].used.store(true, std::memory_order_relaxed);
+                if (block->next.compare_exchange_strong(next, grown.get()))
+                    return grown.release()->slots[0];
+            }
+            block = next;
+        }
+    }
+
+    ThreadSlot& Local()
+    {
+        thread_local ThreadSlots locals;
+        for (const auto& local: locals.slots) {
+            if (local->domain == id_)
+                return *local;
+        }
+        locals.slots.push_back(std::make_unique<ThreadSlot>());
+        locals.slots.back()->domain = id_;
+        return *locals.slots.back();
+    }
+
+public:
+    EpochDomain()
+    {
+        static std::atomic<std::uint64_t> next_id{1};
+        id_ = next_id.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(RegistryMutex());
+        Live().insert(id_);
+    }
+    /**
+     * 析构时不能再有读者处于临界区。
+     */
+    ~EpochDomain()
+    {
+        {
+            std::lock_guard<std::mutex> lock(RegistryMutex());
+            Live().erase(id_);
+        }
+        for (Block* block = head_.next.load(); block != nullptr;) {
+            Block* next = block->next.load();
+            delete block;
+            block = next;
+        }
+    }
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    /**
+     * 进程内共享的回收域。
+     */
+    static EpochDomain& Global()
+    {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    /**
+     * 读者临界区，可以嵌套。登记纪元与随后读取共享指针都使用 seq_cst，与 Synchronize() 中的
+     * 交换指针、推进纪元、扫描槽位构成全序：扫描时读者尚未登记，则它之后读到的必然是新指针。
+     * 新槽位块用 seq_cst 的 CAS 挂到链表上，早于读者在其中登记，所以同样落在这个全序里。
+     */
+    class Guard {
+    private:
+        ThreadSlot& local_;
+
+    public:
+        explicit Guard(EpochDomain& domain) : local_(domain.Local())
+        {
+            if (local_.depth++ != 0)
+                return;
+            if (local_.slot == nullptr)
+                local_.slot = &domain.AcquireSlot();
+            local_.slot->epoch.store(domain.epoch_.load(std::memory_order_relaxed));
+        }
+        ~Guard()
+        {
+            if (--local_.depth == 0)
+                local_.slot->epoch.store(0, std::memory_order_release);
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    /**
+     * 推进纪元并等待所有在此之前进入临界区的读者离开。只阻塞调用它的写者。
+     */
+    void Synchronize()
+    {
+        std::uint64_t target = epoch_.fetch_add(1) + 1;
+        for (Block* block = &head_; block != nullptr; block = block->next.load()) {
+            for (Slot& slot: block->slots) {
+                for (;;) {
+                    std::uint64_t epoch = slot.epoch.load();
+                    if (epoch == 0 || epoch >= target)
+                        break;
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+};
+
+/**
+ * 从共享库加载的实现类。对象由插件的 DestroyImplementation 释放，之后才能关闭共享库。
+ */
+class PluginImplementation {
+private:
+    void* handle_ = nullptr;
+    Implementation* implementation_ = nullptr;
+    DestroyImplementationFn destroy_ = nullptr;
+
+public:
+    explicit PluginImplementation(const std::string& path)
+    {
+        handle_ = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle_ == nullptr)
+            throw std::runtime_error(std::string("PluginImplementation: ") + ::dlerror());
+        auto create = reinterpret_cast<CreateImplementationFn>(::dlsym(handle_, "CreateImplementation"));
+        destroy_ = reinterpret_cast<DestroyImplementationFn>(::dlsym(handle_, "DestroyImplementation"));
+        if (create == nullptr || destroy_ == nullptr) {
+            ::dlclose(handle_);
+            throw std::runtime_error("PluginImplementation: " + path + " does not export the plugin functions");
+        }
+        implementation_ = create();
+    }
+    ~PluginImplementation()
+    {
+        destroy_(implementation_);
+        ::dlclose(handle_);
+    }
+    PluginImplementation(const PluginImplementation&) = delete;
+    PluginImplementation& operator=(const PluginImplementation&) = delete;
+
+    Implementation* get() const
+    {
+        return implementation_;
+    }
+};
+
+/**
+ * 可热替换的实现类：本身也是一个 Implementation，把调用转发给当前的实现，因此抽象类无需任何改动。
+ * 当前实现保存在原子指针中，读路径只有一次纪元登记和一次原子读取，从不阻塞；
+ * Swap() 原子地换上新实现，等宽限期结束后再释放旧实现（对插件而言还会关闭共享库），
+ * 所以正在执行的 Operation() 看到的要么是完整的旧实现，要么是完整的新实现。
+ */
+class SwappableImplementation : public Implementation {
+private:
+    /**
+     * 当前实现及其所有权：插件或调用方交给我们的对象。
+     */
+    struct Current {
+        Implementation* implementation;
+        std::unique_ptr<PluginImplementation> plugin;
+    };
+
+    EpochDomain& domain_;
+    std::atomic<Current*> current_;
+    std::mutex swap_mutex_; // 串行化写者
+
+public:
+    explicit SwappableImplementation(Implementation* implementation, EpochDomain& domain = EpochDomain::Global())
+        : domain_(domain), current_(new Current{implementation, nullptr})
+    {}
+    ~SwappableImplementation() override
+    {
+        delete current_.load();
+    }
+
+    /**
+     * 换成一个由调用方持有的实现。返回时旧实现已不再被任何读者使用。
+     */
+    void Swap(Implementation* implementation)
+    {
+        Retire(new Current{implementation, nullptr});
+    }
+    /**
+     * 换成从共享库加载的实现。
+     */
+    void SwapPlugin(const std::string& path)
+    {
+        auto plugin = std::make_unique<PluginImplementation>(path);
+        Implementation* implementation = plugin->get();
+        Retire(new Current{implementation, std::move(plugin)});
+    }
+
+    std::string OperationImplementation() const override
+    {
+        EpochDomain::Guard guard(domain_);
+        return current_.load()->implementation->OperationImplementation();
+    }
+    void OperationImplementation(Span<std::string> outputs) const override
+    {
+        EpochDomain::Guard guard(domain_);
+        current_.load()->implementation->OperationImplementation(outputs);
+    }
+
+private:
+    void Retire(Current* next)
+    {
+        std::lock_guard<std::mutex> lock(swap_mutex_);
+        Current* previous = current_.exchange(next);
+        domain_.Synchronize();
+        delete previous;
+    }
+};
+
 /**
  * 抽象类定义了“控制”部分的接口，它维护对实现类层次结构中对象的引用，
  * 并将所有实际工作委托给该对象。
@@ -53,6 +352,14 @@ public:
     {
         return "Abstraction: Base operation with:\n" + this->implementation_->OperationImplementation();
     }
+    /**
+     * 批量版本：对 outputs 中的每个元素执行一次 Operation()，结果写入该元素，复用其已有容量。
+     */
+    virtual void Operation(Span<std::string> outputs) const
+    {
+        for (std::string& output: outputs) output.assign("Abstraction: Base operation with:\n");
+        this->implementation_->OperationImplementation(outputs);
+    }
 };
 
 /**
@@ -65,6 +372,11 @@ public:
     {
         return "ExtendedAbstraction: Extended operation with:\n" + this->implementation_->OperationImplementation();
     }
+    void Operation(Span<std::string> outputs) const override
+    {
+        for (std::string& output: outputs) output.assign("ExtendedAbstraction: Extended operation with:\n");
+        this->implementation_->OperationImplementation(outputs);
+    }
 };
 
 /**
@@ -78,11 +390,108 @@ void ClientCode(const Abstraction& abstraction)
     // ...
 }
 
+/**
+ * 对一百万个元素，比较逐个调用 Operation() 与不同批大小的批量 Operation() 的每元素开销。
+ * 平台 A 覆盖了批量接口，平台 B 只有单元素接口，走默认的自动适配。
+ */
+void BenchmarkBatch(std::size_t items = 1000000)
+{
+    ConcreteImplementationA platform_a;
+    ConcreteImplementationB platform_b;
+    for (Implementation* implementation: {static_cast<Implementation*>(&platform_a),
+                                          static_cast<Implementation*>(&platform_b)}) {
+        Abstraction abstraction(implementation);
+        const char* name = implementation == &platform_a ? "A (native batch)" : "B (adapted)     ";
+
+        std::size_t total = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < items; ++i) total += abstraction.Operation().size();
+        double single_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::cout << name << " single item: " << single_ns / items << " ns/item\n";
+
+        for (std::size_t batch: {1, 8, 64, 512, 4096}) {
+            std::vector<std::string> outputs(batch);
+            std::size_t done = 0;
+            start = std::chrono::steady_clock::now();
+            for (; done < items; done += batch) {
+                abstraction.Operation(outputs);
+                total += outputs[0].size();
+            }
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            std::cout << name << " batch " << std::setw(5) << batch << ": " << ns / done << " ns/item\n";
+        }
+        if (total == 0)
+            std::cout << "unexpected empty output\n";
+    }
+}
+
+/**
+ * 读路径开销：直接调用与经过可热替换实现的调用对比；
+ * 热替换延迟：若干读线程满负荷调用的同时，反复在平台 A 与插件平台 C 之间切换。
+ */
+void BenchmarkHotSwap(const std::string& plugin_path, std::size_t calls = 2000000)
+{
+    ConcreteImplementationA platform_a;
+    SwappableImplementation swappable(&platform_a);
+    std::vector<std::string> outputs(1);
+    for (Implementation* implementation: {static_cast<Implementation*>(&platform_a),
+                                          static_cast<Implementation*>(&swappable)}) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < calls; ++i) {
+            outputs[0].clear();
+            implementation->OperationImplementation(outputs);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::cout << (implementation == &platform_a ? "direct    " : "swappable ") << ": " << ns / calls
+                  << " ns/call\n";
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<std::size_t> reads{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            Abstraction abstraction(&swappable);
+            std::size_t local = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                // 结果必须完整来自某一个平台，不会是两者的混合。
+                std::string result = abstraction.Operation();
+                if (result.find("platform A") == std::string::npos && result.find("platform C") == std::string::npos)
+                    std::cout << "torn result: " << result;
+                ++local;
+            }
+            reads.fetch_add(local);
+        });
+    }
+    const int swaps = 200;
+    std::vector<double> latencies;
+    for (int i = 0; i < swaps; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        if (i % 2 == 0)
+            swappable.SwapPlugin(plugin_path);
+        else
+            swappable.Swap(&platform_a);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        latencies.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+    }
+    stop = true;
+    for (std::thread& reader: readers) reader.join();
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "swap under load (4 readers, " << reads << " reads): p50 " << latencies[swaps / 2] << " us, max "
+              << latencies.back() << " us\n";
+}
+
 /**
  * 客户端代码应能够使用任何预配置的抽象类-实现类组合工作。
  */
-int main()
+int main(int argc, char* argv[])
 {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        BenchmarkBatch();
+        BenchmarkHotSwap(argc > 2 ? argv[2] : BRIDGE_PLUGIN_PATH);
+        return 0;
+    }
+
     Implementation* implementation = new ConcreteImplementationA;
     Abstraction* abstraction = new Abstraction(implementation);
     ClientCode(*abstraction);
@@ -97,5 +506,14 @@ int main()
     delete implementation;
     delete abstraction;
 
+    // 在不重建抽象类的情况下，把实现类热替换为从共享库加载的平台 C。
+    ConcreteImplementationA platform_a;
+    SwappableImplementation swappable(&platform_a);
+    abstraction = new Abstraction(&swappable);
+    ClientCode(*abstraction);
+    swappable.SwapPlugin(argc > 1 ? argv[1] : BRIDGE_PLUGIN_PATH);
+    ClientCode(*abstraction);
+    delete abstraction;
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+// 桥接模式：实现类接口
+// Bridge.cpp 与以插件形式动态加载的实现类（BridgePlugin.cpp）共享此头文件。
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * 一段连续对象的视图（C++17 中还没有 std::span）。
+ */
+template <typename T>
+class Span {
+private:
+    T* data_;
+    std::size_t size_;
+
+public:
+    Span(T* data, std::size_t size) : data_(data), size_(size) {}
+    Span(std::vector<T>& vector) : data_(vector.data()), size_(vector.size()) {}
+
+    T* begin() const
+    {
+        return data_;
+    }
+    T* end() const
+    {
+        return data_ + size_;
+    }
+    std::size_t size() const
+    {
+        return size_;
+    }
+    T& operator[](std::size_t i) const
+    {
+        return data_[i];
+    }
+    Span subspan(std::size_t offset, std::size_t count) const
+    {
+        return Span(data_ + offset, count);
+    }
+};
+
+/**
+ * 定义了所有实现类的接口。它不必与抽象类的接口相匹配。实际上，
+ * 这两个接口可以完全不同。通常，实现类的接口仅提供原始操作，而抽象类
+ * 基于这些原始操作定义了更高级别的操作。
+ */
+class Implementation {
+public:
+    virtual ~Implementation() {}
+    virtual std::string OperationImplementation() const = 0;
+    /**
+     * 批量接口：把结果追加到每个 outputs[i] 的末尾，一次虚调用处理整批元素。
+     * 默认实现逐个调用单元素接口，因此只实现了单元素接口的平台会自动适配；
+     * 平台可以覆盖它，在一次调用内完成整批（例如直接拷贝、复用 outputs 已有的容量或使用 SIMD）。
+     */
+    virtual void OperationImplementation(Span<std::string> outputs) const
+    {
+        for (std::string& output: outputs) output += this->OperationImplementation();
+    }
+};
+
+/**
+ * 以共享库形式提供的实现类插件必须以 extern "C" 导出这两个函数，由加载方负责成对调用：
+ *   Implementation* CreateImplementation();
+ *   void DestroyImplementation(Implementation*);
+ */
+using CreateImplementationFn = Implementation* (*)();
+using DestroyImplementationFn = void (*)(Implementation*);
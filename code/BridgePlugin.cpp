@@ -0,0 +1,29 @@
+// 桥接模式：以共享库形式动态加载的实现类
+#include "BridgeImplementation.h"
+
+/**
+ * 平台 C 不随主程序编译，而是在运行时通过 dlopen 加载，并可以热替换正在使用的实现类。
+ */
+class ConcreteImplementationC : public Implementation {
+    static constexpr char kResult[] = "ConcreteImplementationC: Here's the result on the plugin platform C.\n";
+
+public:
+    std::string OperationImplementation() const override
+    {
+        return kResult;
+    }
+    void OperationImplementation(Span<std::string> outputs) const override
+    {
+        for (std::string& output: outputs) output.append(kResult, sizeof(kResult) - 1);
+    }
+};
+
+extern "C" Implementation* CreateImplementation()
+{
+    return new ConcreteImplementationC;
+}
+
+extern "C" void DestroyImplementation(Implementation* implementation)
+{
+    delete implementation;
+}
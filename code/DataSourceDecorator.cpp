@@ -0,0 +1,779 @@
+//
+// 装饰模式：数据源
+// 对应 装饰模式.md 中的数据源示例：用装饰器在数据源外叠加缓冲、校验和压缩等行为。
+// 各层之间传递的是 std::string_view 缓冲区视图，只有确实需要改写数据（压缩/解压、合并小块）的层才会复制。
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#endif
+
+/**
+ * 数据源接口同时声明写入和读取两个方向的操作，数据以视图的形式在各层之间传递。
+ */
+class DataSource {
+public:
+    virtual ~DataSource() = default;
+    /**
+     * 写入 data。data 只在调用期间有效，需要保留数据的实现必须自行复制。
+     */
+    virtual void WriteData(std::string_view data) = 0;
+    /**
+     * 把各层缓存的数据全部写到底层。
+     */
+    virtual void Flush() {}
+    /**
+     * 读取下一段数据，返回的视图在下一次调用 ReadData() 之前有效；返回空视图表示读完。
+     */
+    virtual std::string_view ReadData() = 0;
+};
+
+/**
+ * 具体组件：文件数据源。写入直接交给 write(2)，读取时把整个文件映射到内存，按块返回映射区域的视图。
+ */
+class FileDataSource : public DataSource {
+public:
+    enum class Mode { Read, Write };
+    static constexpr std::size_t kReadChunk = 1 << 20;
+
+private:
+    int fd_ = -1;
+    const char* map_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t offset_ = 0;
+
+public:
+    FileDataSource(const std::filesystem::path& path, Mode mode)
+    {
+        fd_ = mode == Mode::Write ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)
+                                  : ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0)
+            throw std::system_error(errno, std::generic_category(), "FileDataSource: open " + path.string());
+        if (mode == Mode::Write)
+            return;
+        struct stat st {};
+        if (::fstat(fd_, &st) != 0) {
+            int error = errno;
+            ::close(fd_);
+            throw std::system_error(error, std::generic_category(), "FileDataSource: fstat " + path.string());
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ == 0)
+            return;
+        void* map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (map == MAP_FAILED) {
+            int error = errno;
+            ::close(fd_);
+            throw std::system_error(error, std::generic_category(), "FileDataSource: mmap " + path.string());
+        }
+        ::madvise(map, size_, MADV_SEQUENTIAL);
+        map_ = static_cast<const char*>(map);
+    }
+    ~FileDataSource() override
+    {
+        if (map_ != nullptr)
+            ::munmap(const_cast<char*>(map_), size_);
+        ::close(fd_);
+    }
+
+    void WriteData(std::string_view data) override
+    {
+        while (!data.empty()) {
+            ssize_t n = ::write(fd_, data.data(), data.size());
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw std::system_error(errno, std::generic_category(), "FileDataSource: write");
+            data.remove_prefix(static_cast<std::size_t>(n));
+        }
+    }
+    std::string_view ReadData() override
+    {
+        std::size_t n = std::min(kReadChunk, size_ - offset_);
+        std::string_view chunk(map_ + offset_, n);
+        offset_ += n;
+        return chunk;
+    }
+};
+
+/**
+ * 基础装饰器把所有工作委托给被包装的数据源。
+ */
+class DataSourceDecorator : public DataSource {
+protected:
+    DataSource* wrappee_;
+
+public:
+    explicit DataSourceDecorator(DataSource* source) : wrappee_(source) {}
+
+    void WriteData(std::string_view data) override
+    {
+        wrappee_->WriteData(data);
+    }
+    void Flush() override
+    {
+        wrappee_->Flush();
+    }
+    std::string_view ReadData() override
+    {
+        return wrappee_->ReadData();
+    }
+};
+
+/**
+ * 缓冲装饰器：把小块写入合并成 capacity 大小再往下传，大块写入直接透传视图；
+ * 读取时同样把下层返回的小块合并，大块直接透传。
+ */
+class BufferingDecorator : public DataSourceDecorator {
+private:
+    std::vector<char> buffer_;
+    std::size_t used_ = 0;
+    std::string_view pending_; // 读取时下层返回、尚未交出的数据
+
+public:
+    explicit BufferingDecorator(DataSource* source, std::size_t capacity = 256 * 1024)
+        : DataSourceDecorator(source), buffer_(capacity)
+    {}
+
+    void WriteData(std::string_view data) override
+    {
+        if (used_ + data.size() <= buffer_.size()) {
+            std::memcpy(buffer_.data() + used_, data.data(), data.size());
+            used_ += data.size();
+            return;
+        }
+        FlushBuffer();
+        if (data.size() >= buffer_.size()) {
+            wrappee_->WriteData(data);
+            return;
+        }
+        std::memcpy(buffer_.data(), data.data(), data.size());
+        used_ = data.size();
+    }
+    void Flush() override
+    {
+        FlushBuffer();
+        wrappee_->Flush();
+    }
+    std::string_view ReadData() override
+    {
+        if (pending_.empty())
+            pending_ = wrappee_->ReadData();
+        if (pending_.size() >= buffer_.size() / 2 || pending_.empty()) {
+            std::string_view chunk = pending_;
+            pending_ = {};
+            return chunk;
+        }
+        // 合并小块：视图在下一次调用下层 ReadData() 之前一直有效，放不下的部分留到下次。
+        std::size_t used = 0;
+        while (!pending_.empty()) {
+            std::size_t n = std::min(pending_.size(), buffer_.size() - used);
+            std::memcpy(buffer_.data() + used, pending_.data(), n);
+            used += n;
+            pending_.remove_prefix(n);
+            if (used == buffer_.size())
+                break;
+            pending_ = wrappee_->ReadData();
+        }
+        return std::string_view(buffer_.data(), used);
+    }
+
+private:
+    void FlushBuffer()
+    {
+        if (used_ != 0)
+            wrappee_->WriteData(std::string_view(buffer_.data(), used_));
+        used_ = 0;
+    }
+};
+
+/**
+ * CRC32C（Castagnoli）。x86-64 上支持 SSE4.2 时使用硬件指令，否则使用按 8 字节查表的软件实现。
+ */
+class Crc32c {
+private:
+    static constexpr std::uint32_t kPolynomial = 0x82F63B78;
+
+    using Table = std::array<std::array<std::uint32_t, 256>, 8>;
+
+    static const Table& Tables()
+    {
+        static const Table tables = [] {
+            Table t{};
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                std::uint32_t crc = i;
+                for (int k = 0; k < 8; ++k) crc = crc & 1 ? (crc >> 1) ^ kPolynomial : crc >> 1;
+                t[0][i] = crc;
+            }
+            for (std::uint32_t i = 0; i < 256; ++i)
+                for (int k = 1; k < 8; ++k) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+            return t;
+        }();
+        return tables;
+    }
+
+    static std::uint32_t Software(std::uint32_t crc, const unsigned char* p, std::size_t n)
+    {
+        const Table& t = Tables();
+        for (; n >= 8; n -= 8, p += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, p, 8);
+            word ^= crc;
+            crc = t[7][word & 0xFF] ^ t[6][(word >> 8) & 0xFF] ^ t[5][(word >> 16) & 0xFF] ^
+                  t[4][(word >> 24) & 0xFF] ^ t[3][(word >> 32) & 0xFF] ^ t[2][(word >> 40) & 0xFF] ^
+                  t[1][(word >> 48) & 0xFF] ^ t[0][word >> 56];
+        }
+        for (; n > 0; --n, ++p) crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+        return crc;
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("sse4.2"))) static std::uint32_t Hardware(std::uint32_t crc, const unsigned char* p,
+                                                                      std::size_t n)
+    {
+        std::uint64_t crc64 = crc;
+        for (; n >= 8; n -= 8, p += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, p, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = static_cast<std::uint32_t>(crc64);
+        for (; n > 0; --n, ++p) crc = _mm_crc32_u8(crc, *p);
+        return crc;
+    }
+
+    static bool HasHardware()
+    {
+        static const bool supported = __builtin_cpu_supports("sse4.2");
+        return supported;
+    }
+#endif
+
+public:
+    /**
+     * 在 crc 的基础上继续累加 data。初始值为 0，结果即标准 CRC32C。
+     */
+    static std::uint32_t Extend(std::uint32_t crc, std::string_view data)
+    {
+        const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+        crc = ~crc;
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (HasHardware())
+            return ~Hardware(crc, p, data.size());
+#endif
+        return ~Software(crc, p, data.size());
+    }
+};
+
+/**
+ * 校验装饰器：对流经的数据计算 CRC32C，数据本身原样透传，不做任何复制。
+ */
+class ChecksumDecorator : public DataSourceDecorator {
+private:
+    std::uint32_t crc_ = 0;
+
+public:
+    using DataSourceDecorator::DataSourceDecorator;
+
+    std::uint32_t Checksum() const
+    {
+        return crc_;
+    }
+
+    void WriteData(std::string_view data) override
+    {
+        crc_ = Crc32c::Extend(crc_, data);
+        wrappee_->WriteData(data);
+    }
+    std::string_view ReadData() override
+    {
+        std::string_view chunk = wrappee_->ReadData();
+        crc_ = Crc32c::Extend(crc_, chunk);
+        return chunk;
+    }
+};
+
+/**
+ * LZ77 类的快速块压缩（格式与 LZ4 块格式相同）：每个序列由一个标记字节、字面量、2 字节偏移和匹配长度组成，
+ * 最后一个序列只有字面量。
+ */
+class Lz {
+private:
+    static constexpr int kHashBits = 14;
+    static constexpr std::size_t kMinMatch = 4;
+    static constexpr std::size_t kLastLiterals = 5;
+    static constexpr std::size_t kMatchFindLimit = 12;
+
+    static std::uint32_t Read32(const unsigned char* p)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, p, 4);
+        return value;
+    }
+    static std::uint64_t Read64(const unsigned char* p)
+    {
+        std::uint64_t value;
+        std::memcpy(&value, p, 8);
+        return value;
+    }
+    /**
+     * ip 与 ref 处的公共前缀长度（不越过 limit），每次比较 8 字节。
+     */
+    static std::size_t MatchLength(const unsigned char* ip, const unsigned char* ref, const unsigned char* limit)
+    {
+        const unsigned char* start = ip;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        for (; ip + 8 <= limit; ip += 8, ref += 8) {
+            std::uint64_t diff = Read64(ip) ^ Read64(ref);
+            if (diff != 0)
+                return static_cast<std::size_t>(ip - start) + (__builtin_ctzll(diff) >> 3);
+        }
+#endif
+        while (ip < limit && *ip == *ref) ++ip, ++ref;
+        return static_cast<std::size_t>(ip - start);
+    }
+    static std::uint32_t Hash(std::uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - kHashBits);
+    }
+    static unsigned char* WriteLength(unsigned char* op, std::size_t length)
+    {
+        for (; length >= 255; length -= 255) *op++ = 255;
+        *op++ = static_cast<unsigned char>(length);
+        return op;
+    }
+    static unsigned char* WriteSequence(unsigned char* op, const unsigned char* literals, std::size_t literal_length,
+                                        std::size_t offset, std::size_t match_length)
+    {
+        unsigned char* token = op++;
+        *token = static_cast<unsigned char>(std::min<std::size_t>(literal_length, 15) << 4);
+        if (literal_length >= 15)
+            op = WriteLength(op, literal_length - 15);
+        std::memcpy(op, literals, literal_length);
+        op += literal_length;
+        if (offset == 0)
+            return op;
+        *op++ = static_cast<unsigned char>(offset);
+        *op++ = static_cast<unsigned char>(offset >> 8);
+        std::size_t length = match_length - kMinMatch;
+        *token |= static_cast<unsigned char>(std::min<std::size_t>(length, 15));
+        if (length >= 15)
+            op = WriteLength(op, length - 15);
+        return op;
+    }
+    /**
+     * 把 op - offset 处的 length 字节复制到 op。偏移不小于 8 且输出留有余量时按 8 字节整段复制
+     * （每段的源都在已写出的区域内），否则按重叠与否选择 memcpy 或逐字节复制。
+     */
+    static void CopyMatch(unsigned char* op, std::size_t offset, std::size_t length, const unsigned char* op_end)
+    {
+        const unsigned char* match = op - offset;
+        if (offset >= 8 && static_cast<std::size_t>(op_end - op) >= length + 8) {
+            for (std::size_t i = 0; i < length; i += 8) std::memcpy(op + i, match + i, 8);
+        }
+        else if (offset >= length) {
+            std::memcpy(op, match, length);
+        }
+        else {
+            // 重叠匹配（例如连续重复的字节）只能逐字节复制。
+            for (std::size_t i = 0; i < length; ++i) op[i] = match[i];
+        }
+    }
+
+public:
+    static constexpr std::size_t Bound(std::size_t size)
+    {
+        return size + size / 255 + 16;
+    }
+
+    /**
+     * 压缩 src，dst 至少要有 Bound(src.size()) 字节，返回压缩后的长度。
+     */
+    static std::size_t Compress(std::string_view src, char* dst)
+    {
+        const auto* base = reinterpret_cast<const unsigned char*>(src.data());
+        const unsigned char* ip = base;
+        const unsigned char* anchor = base;
+        const unsigned char* end = base + src.size();
+        auto* op = reinterpret_cast<unsigned char*>(dst);
+
+        if (src.size() >= kMatchFindLimit + 1) {
+            std::array<std::uint32_t, 1 << kHashBits> table;
+            table.fill(0);
+            const unsigned char* match_find_limit = end - kMatchFindLimit;
+            const unsigned char* match_limit = end - kLastLiterals;
+            ++ip;
+            while (ip < match_find_limit) {
+                std::uint32_t sequence = Read32(ip);
+                std::uint32_t& slot = table[Hash(sequence)];
+                const unsigned char* ref = base + slot;
+                slot = static_cast<std::uint32_t>(ip - base);
+                if (ref >= ip || ip - ref > 65535 || Read32(ref) != sequence) {
+                    // 长时间找不到匹配时加大步长，快速跳过不可压缩的数据。
+                    ip += 1 + ((ip - anchor) >> 6);
+                    continue;
+                }
+                std::size_t length = kMinMatch + MatchLength(ip + kMinMatch, ref + kMinMatch, match_limit);
+                op = WriteSequence(op, anchor, static_cast<std::size_t>(ip - anchor),
+                                   static_cast<std::size_t>(ip - ref), length);
+                ip += length;
+                anchor = ip;
+            }
+        }
+        op = WriteSequence(op, anchor, static_cast<std::size_t>(end - anchor), 0, 0);
+        return static_cast<std::size_t>(op - reinterpret_cast<unsigned char*>(dst));
+    }
+
+    /**
+     * 解压 src 到 dst（容量为 capacity），返回解压后的长度；数据损坏时抛出 std::runtime_error。
+     */
+    static std::size_t Decompress(std::string_view src, char* dst, std::size_t capacity)
+    {
+        const auto* ip = reinterpret_cast<const unsigned char*>(src.data());
+        const unsigned char* end = ip + src.size();
+        auto* op = reinterpret_cast<unsigned char*>(dst);
+        unsigned char* op_end = op + capacity;
+        auto read_length = [&](std::size_t length) {
+            if (length == 15) {
+                unsigned char byte;
+                do {
+                    if (ip >= end)
+                        throw std::runtime_error("Lz: truncated length");
+                    byte = *ip++;
+                    length += byte;
+                } while (byte == 255);
+            }
+            return length;
+        };
+        while (ip < end) {
+            unsigned char token = *ip++;
+            // 快速路径：短字面量且两侧都留有 16 字节余量时整段复制 16 字节，多写的部分随后会被覆盖。
+            if ((token >> 4) < 15 && end - ip >= 16 && op_end - op >= 16) {
+                std::size_t literal_length = token >> 4;
+                std::memcpy(op, ip, 16);
+                op += literal_length;
+                ip += literal_length;
+                if (ip == end)
+                    break;
+                std::size_t offset = ip[0] | std::size_t(ip[1]) << 8;
+                ip += 2;
+                std::size_t match_length = read_length(token & 15) + kMinMatch;
+                if (offset == 0 || offset > static_cast<std::size_t>(op - reinterpret_cast<unsigned char*>(dst)) ||
+                    match_length > static_cast<std::size_t>(op_end - op))
+                    throw std::runtime_error("Lz: match out of range");
+                CopyMatch(op, offset, match_length, op_end);
+                op += match_length;
+                continue;
+            }
+            std::size_t literal_length = read_length(token >> 4);
+            if (literal_length > static_cast<std::size_t>(end - ip) ||
+                literal_length > static_cast<std::size_t>(op_end - op))
+                throw std::runtime_error("Lz: literals out of range");
+            std::memcpy(op, ip, literal_length);
+            op += literal_length;
+            ip += literal_length;
+            if (ip == end)
+                break;
+            if (end - ip < 2)
+                throw std::runtime_error("Lz: truncated offset");
+            std::size_t offset = ip[0] | std::size_t(ip[1]) << 8;
+            ip += 2;
+            std::size_t match_length = read_length(token & 15) + kMinMatch;
+            if (offset == 0 || offset > static_cast<std::size_t>(op - reinterpret_cast<unsigned char*>(dst)) ||
+                match_length > static_cast<std::size_t>(op_end - op))
+                throw std::runtime_error("Lz: match out of range");
+            CopyMatch(op, offset, match_length, op_end);
+            op += match_length;
+        }
+        return static_cast<std::size_t>(op - reinterpret_cast<unsigned char*>(dst));
+    }
+};
+
+/**
+ * 压缩装饰器：写入时按 kBlockSize 分块压缩，每块前加 8 字节帧头（原始长度、存储长度），
+ * 压不小的块原样存储（存储长度最高位置 1）。读取时按帧解压，原样存储的块直接返回下层数据的视图。
+ */
+class CompressionDecorator : public DataSourceDecorator {
+public:
+    static constexpr std::size_t kBlockSize = 64 * 1024;
+
+private:
+    static constexpr std::uint32_t kStoredFlag = 0x80000000u;
+
+    std::vector<char> block_; // 写入时尚未凑满一块的数据
+    std::size_t block_used_ = 0;
+    std::vector<char> frame_; // 帧头 + 压缩数据，写读两个方向共用
+    std::vector<char> output_; // 解压结果
+    std::string_view chunk_; // 读取时下层返回、尚未解析的数据
+    std::vector<char> staging_; // 跨越下层数据块边界的帧需要拼接
+
+    void WriteBlock(std::string_view block)
+    {
+        std::size_t compressed = Lz::Compress(block, frame_.data() + 8);
+        std::uint32_t raw_size = static_cast<std::uint32_t>(block.size());
+        std::uint32_t stored_size = static_cast<std::uint32_t>(compressed);
+        if (compressed >= block.size()) {
+            // 不可压缩：帧头和原始数据分两次往下写，避免复制原始数据。
+            stored_size = raw_size | kStoredFlag;
+            std::memcpy(frame_.data(), &raw_size, 4);
+            std::memcpy(frame_.data() + 4, &stored_size, 4);
+            wrappee_->WriteData(std::string_view(frame_.data(), 8));
+            wrappee_->WriteData(block);
+            return;
+        }
+        std::memcpy(frame_.data(), &raw_size, 4);
+        std::memcpy(frame_.data() + 4, &stored_size, 4);
+        wrappee_->WriteData(std::string_view(frame_.data(), 8 + compressed));
+    }
+
+    /**
+     * 从下层取出恰好 n 字节：能在当前数据块内取到就直接返回视图，否则拼接到 staging_。
+     * 返回 false 表示在帧开始处遇到数据结尾。
+     */
+    bool Take(std::size_t n, std::string_view& out)
+    {
+        if (chunk_.empty())
+            chunk_ = wrappee_->ReadData();
+        if (chunk_.empty())
+            return false;
+        if (chunk_.size() >= n) {
+            out = chunk_.substr(0, n);
+            chunk_.remove_prefix(n);
+            return true;
+        }
+        staging_.resize(n);
+        std::size_t used = 0;
+        while (used < n) {
+            if (chunk_.empty())
+                chunk_ = wrappee_->ReadData();
+            if (chunk_.empty())
+                throw std::runtime_error("CompressionDecorator: truncated frame");
+            std::size_t k = std::min(n - used, chunk_.size());
+            std::memcpy(staging_.data() + used, chunk_.data(), k);
+            used += k;
+            chunk_.remove_prefix(k);
+        }
+        out = std::string_view(staging_.data(), n);
+        return true;
+    }
+
+public:
+    explicit CompressionDecorator(DataSource* source)
+        : DataSourceDecorator(source), block_(kBlockSize), frame_(8 + Lz::Bound(kBlockSize)), output_(kBlockSize)
+    {}
+
+    void WriteData(std::string_view data) override
+    {
+        if (block_used_ != 0) {
+            std::size_t n = std::min(data.size(), kBlockSize - block_used_);
+            std::memcpy(block_.data() + block_used_, data.data(), n);
+            block_used_ += n;
+            data.remove_prefix(n);
+            if (block_used_ < kBlockSize)
+                return;
+            WriteBlock(std::string_view(block_.data(), block_used_));
+            block_used_ = 0;
+        }
+        // 整块直接从调用方的视图压缩，不先复制到 block_。
+        for (; data.size() >= kBlockSize; data.remove_prefix(kBlockSize)) WriteBlock(data.substr(0, kBlockSize));
+        std::memcpy(block_.data(), data.data(), data.size());
+        block_used_ = data.size();
+    }
+    void Flush() override
+    {
+        if (block_used_ != 0)
+            WriteBlock(std::string_view(block_.data(), block_used_));
+        block_used_ = 0;
+        wrappee_->Flush();
+    }
+    std::string_view ReadData() override
+    {
+        std::string_view header;
+        if (!Take(8, header))
+            return {};
+        std::uint32_t raw_size, stored_size;
+        std::memcpy(&raw_size, header.data(), 4);
+        std::memcpy(&stored_size, header.data() + 4, 4);
+        if (raw_size > kBlockSize)
+            throw std::runtime_error("CompressionDecorator: corrupt frame header");
+        std::string_view payload;
+        if (stored_size & kStoredFlag) {
+            if ((stored_size & ~kStoredFlag) != raw_size || !Take(raw_size, payload))
+                throw std::runtime_error("CompressionDecorator: corrupt stored frame");
+            return payload;
+        }
+        if (stored_size > Lz::Bound(kBlockSize) || !Take(stored_size, payload))
+            throw std::runtime_error("CompressionDecorator: corrupt frame");
+        if (Lz::Decompress(payload, output_.data(), raw_size) != raw_size)
+            throw std::runtime_error("CompressionDecorator: size mismatch");
+        return std::string_view(output_.data(), raw_size);
+    }
+};
+
+/**
+ * 客户端代码只依赖 DataSource 接口，不关心数据经过了哪些装饰器。
+ */
+void ClientCode(DataSource* source, std::string_view record)
+{
+    source->WriteData(record);
+    source->Flush();
+}
+
+std::string ReadAll(DataSource* source)
+{
+    std::string result;
+    for (std::string_view chunk = source->ReadData(); !chunk.empty(); chunk = source->ReadData()) result += chunk;
+    return result;
+}
+
+/**
+ * 生成便于压缩又不过分重复的测试数据：由随机挑选的单词组成的“文本”。
+ */
+std::string MakeCorpus(std::size_t size)
+{
+    static const char* words[] = {"decorator", "component ", "stream", " buffer ", "checksum", "compress ",
+                                  "zero-copy", " view", "\n", "data source ", "wrappee", "flush "};
+    std::mt19937 rng(5);
+    std::string corpus;
+    corpus.reserve(size + 16);
+    while (corpus.size() < size) {
+        corpus += words[rng() % 12];
+        corpus += static_cast<char>('a' + rng() % 26);
+    }
+    corpus.resize(size);
+    return corpus;
+}
+
+/**
+ * 每个装饰器以及常见组合的写入/读取吞吐量，数据写到本地临时文件再读回校验。
+ */
+void BenchmarkDataSources(std::size_t size = 256 << 20)
+{
+    std::string corpus = MakeCorpus(size);
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "decorator-data-source.bin";
+    const std::size_t kWrite = 16 * 1024; // 客户端每次写入的大小
+    std::uint32_t expected_crc = Crc32c::Extend(0, corpus);
+
+    auto gbps = [size](std::chrono::steady_clock::duration elapsed) {
+        return double(size) / std::chrono::duration<double>(elapsed).count() / 1e9;
+    };
+    auto bench = [&](const char* name, bool buffering, bool checksum, bool compression) {
+        std::uint32_t write_crc = 0, read_crc = 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            FileDataSource file(path, FileDataSource::Mode::Write);
+            std::vector<std::unique_ptr<DataSource>> stack;
+            DataSource* top = &file;
+            if (buffering)
+                top = stack.emplace_back(std::make_unique<BufferingDecorator>(top)).get();
+            if (compression)
+                top = stack.emplace_back(std::make_unique<CompressionDecorator>(top)).get();
+            ChecksumDecorator* crc = nullptr;
+            if (checksum)
+                top = crc = static_cast<ChecksumDecorator*>(
+                        stack.emplace_back(std::make_unique<ChecksumDecorator>(top)).get());
+            for (std::size_t offset = 0; offset < size; offset += kWrite)
+                top->WriteData(std::string_view(corpus).substr(offset, kWrite));
+            top->Flush();
+            write_crc = crc != nullptr ? crc->Checksum() : expected_crc;
+        }
+        auto write_elapsed = std::chrono::steady_clock::now() - start;
+        std::size_t on_disk = std::filesystem::file_size(path);
+
+        start = std::chrono::steady_clock::now();
+        std::size_t read = 0;
+        static volatile std::uint64_t digest = 0;
+        {
+            FileDataSource file(path, FileDataSource::Mode::Read);
+            std::vector<std::unique_ptr<DataSource>> stack;
+            DataSource* top = &file;
+            if (buffering)
+                top = stack.emplace_back(std::make_unique<BufferingDecorator>(top)).get();
+            if (compression)
+                top = stack.emplace_back(std::make_unique<CompressionDecorator>(top)).get();
+            ChecksumDecorator* crc = nullptr;
+            if (checksum)
+                top = crc = static_cast<ChecksumDecorator*>(
+                        stack.emplace_back(std::make_unique<ChecksumDecorator>(top)).get());
+            // 读出每一个字节（按 8 字节异或），只传视图的组合也要真正把数据从页缓存读进来。
+            for (std::string_view chunk = top->ReadData(); !chunk.empty(); chunk = top->ReadData()) {
+                std::uint64_t x = 0;
+                std::size_t i = 0;
+                for (; i + 8 <= chunk.size(); i += 8) {
+                    std::uint64_t word;
+                    std::memcpy(&word, chunk.data() + i, 8);
+                    x ^= word;
+                }
+                for (; i < chunk.size(); ++i) x ^= static_cast<unsigned char>(chunk[i]);
+                digest = digest ^ x;
+                read += chunk.size();
+            }
+            read_crc = crc != nullptr ? crc->Checksum() : expected_crc;
+        }
+        auto read_elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << std::left << std::setw(34) << name << std::right << " write " << std::setw(6)
+                  << std::setprecision(3) << gbps(write_elapsed) << " GB/s, read " << std::setw(6) << gbps(read_elapsed) << " GB/s, ratio "
+                  << double(on_disk) / double(size) << ", ok " << std::boolalpha
+                  << (read == size && write_crc == expected_crc && read_crc == expected_crc) << "\n";
+    };
+
+    bench("file", false, false, false);
+    bench("buffering > file", true, false, false);
+    bench("checksum > file", false, true, false);
+    bench("compression > file", false, false, true);
+    bench("checksum > compression > buffering", true, true, true);
+    std::filesystem::remove(path);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        BenchmarkDataSources();
+        return 0;
+    }
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "decorator-salary.dat";
+    std::string record = "Name,Salary\nJohn Smith,100000\nSteven Jobs,912000\n";
+
+    // 校验 > 压缩 > 缓冲 > 文件
+    {
+        FileDataSource file(path, FileDataSource::Mode::Write);
+        BufferingDecorator buffering(&file);
+        CompressionDecorator compression(&buffering);
+        ChecksumDecorator checksum(&compression);
+        std::cout << "Client: Writing through checksum > compression > buffering > file\n";
+        ClientCode(&checksum, record);
+        std::cout << "CRC32C of written data: " << std::hex << checksum.Checksum() << std::dec << "\n";
+    }
+    std::cout << "Stored " << std::filesystem::file_size(path) << " bytes for " << record.size() << " input bytes\n";
+
+    std::cout << "\nClient: Reading through checksum > compression > file:\n";
+    {
+        FileDataSource file(path, FileDataSource::Mode::Read);
+        CompressionDecorator compression(&file);
+        ChecksumDecorator checksum(&compression);
+        std::cout << ReadAll(&checksum);
+        std::cout << "CRC32C of read data: " << std::hex << checksum.Checksum() << std::dec << "\n";
+    }
+    std::filesystem::remove(path);
+    return 0;
+}
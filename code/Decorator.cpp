@@ -1,9 +1,18 @@
 //
 // Created by Listening on 2023/4/12.
 // 装饰模式
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 /**
  * 基本组件接口定义了可以由装饰器更改的操作。
@@ -12,15 +21,62 @@ class Component {
 public:
     virtual ~Component() = default;
     virtual std::string Operation() const = 0;
+
+    /**
+     * 单次渲染：先自顶向下算出整个装饰栈输出的总长度，分配一次缓冲区，再让每一层依次写入自己的前缀、
+     * 被包装对象的输出和后缀。深度为 d 的栈只分配一次、每个字节只写一次，而 Operation() 要复制 d 次。
+     */
+    std::string Render() const
+    {
+        std::size_t size = this->RenderedSize();
+        std::string result(size, '\0');
+        char* end = this->RenderTo(result.data());
+        // RenderTo() 写入的长度必须与 RenderedSize() 一致，否则某一层的两个覆盖不匹配。
+        if (end != result.data() + size)
+            throw std::logic_error("Component: RenderTo() does not match RenderedSize()");
+        return result;
+    }
+    /**
+     * Render() 的输出长度，默认实现退回到 Operation()。
+     */
+    virtual std::size_t RenderedSize() const
+    {
+        return this->Operation().size();
+    }
+    /**
+     * 把输出写到 out，返回写入结束的位置，默认实现退回到 Operation()。
+     */
+    virtual char* RenderTo(char* out) const
+    {
+        std::string result = this->Operation();
+        return std::copy(result.begin(), result.end(), out);
+    }
+
+protected:
+    static char* Write(char* out, std::string_view text)
+    {
+        std::memcpy(out, text.data(), text.size());
+        return out + text.size();
+    }
 };
 /**
  * 具体组件类提供操作的默认实现。这些类可能有多种变体。
  */
 class ConcreteComponent : public Component {
+    static constexpr std::string_view kName = "ConcreteComponent";
+
 public:
     std::string Operation() const override
     {
-        return "ConcreteComponent";
+        return std::string(kName);
+    }
+    std::size_t RenderedSize() const override
+    {
+        return kName.size();
+    }
+    char* RenderTo(char* out) const override
+    {
+        return Write(out, kName);
     }
 };
 /**
@@ -37,7 +93,8 @@ protected:
 public:
     Decorator(Component* component) : component_(component) {}
     /**
-   * 装饰器将所有工作委托给包装的组件。
+   * 装饰器将所有工作委托给包装的组件。RenderedSize()/RenderTo() 不在这里转发：只覆盖 Operation() 的子类
+   * 沿用 Component 的默认实现，经由 Operation() 渲染，装饰不会丢失；需要单次渲染的装饰器自己覆盖这两个函数。
    */
     std::string Operation() const override
     {
@@ -58,6 +115,19 @@ public:
     {
         return "ConcreteDecoratorA(" + Decorator::Operation() + ")";
     }
+    std::size_t RenderedSize() const override
+    {
+        return kPrefix.size() + this->component_->RenderedSize() + kSuffix.size();
+    }
+    char* RenderTo(char* out) const override
+    {
+        out = Write(out, kPrefix);
+        out = this->component_->RenderTo(out);
+        return Write(out, kSuffix);
+    }
+
+    static constexpr std::string_view kPrefix = "ConcreteDecoratorA(";
+    static constexpr std::string_view kSuffix = ")";
 };
 /**
  * 装饰器可以在调用一个被包装的对象之前或之后执行其行为。
@@ -70,7 +140,89 @@ public:
     {
         return "ConcreteDecoratorB(" + Decorator::Operation() + ")";
     }
+    std::size_t RenderedSize() const override
+    {
+        return kPrefix.size() + this->component_->RenderedSize() + kSuffix.size();
+    }
+    char* RenderTo(char* out) const override
+    {
+        out = Write(out, kPrefix);
+        out = this->component_->RenderTo(out);
+        return Write(out, kSuffix);
+    }
+
+    static constexpr std::string_view kPrefix = "ConcreteDecoratorB(";
+    static constexpr std::string_view kSuffix = ")";
+};
+/**
+ * 编译期装饰：当装饰栈在编译期就已确定时，把每一层写成只描述自身行为（前缀和后缀）的策略类，
+ * 由 Decorated<Core, Layers...> 静态组合。Layers 按从内到外的顺序排列，
+ * 即 Decorated<ConcreteComponent, StaticDecoratorA, StaticDecoratorB> 与
+ * ConcreteDecoratorB(ConcreteDecoratorA(ConcreteComponent)) 输出相同。
+ *
+ * 整个栈只有对外的一次虚调用（Decorated 本身仍是 Component，可以用在任何需要 Component 的地方），
+ * 内部对核心组件的调用以限定名进行、不经过虚表，各层的前后缀都是编译期常量，可以完全内联。
+ */
+struct StaticDecoratorA {
+    static constexpr std::string_view kPrefix = ConcreteDecoratorA::kPrefix;
+    static constexpr std::string_view kSuffix = ConcreteDecoratorA::kSuffix;
+};
+struct StaticDecoratorB {
+    static constexpr std::string_view kPrefix = ConcreteDecoratorB::kPrefix;
+    static constexpr std::string_view kSuffix = ConcreteDecoratorB::kSuffix;
+};
+
+template <typename Core, typename... Layers>
+class Decorated final : public Component {
+private:
+    Core core_;
+
+    static constexpr std::size_t kDecorationSize =
+            (std::size_t(0) + ... + (Layers::kPrefix.size() + Layers::kSuffix.size()));
+
+    /**
+     * 前缀从外到内写，后缀从内到外写。
+     */
+    template <std::size_t... I>
+    static char* WritePrefixes(char* out, std::index_sequence<I...>)
+    {
+        using Stack = std::tuple<Layers...>;
+        ((out = Write(out, std::tuple_element_t<sizeof...(Layers) - 1 - I, Stack>::kPrefix)), ...);
+        return out;
+    }
+    static char* WriteSuffixes(char* out)
+    {
+        ((out = Write(out, Layers::kSuffix)), ...);
+        return out;
+    }
+
+    template <typename... Args>
+    static constexpr bool kIsSelf = sizeof...(Args) == 1 && (std::is_same_v<std::decay_t<Args>, Decorated> && ...);
+
+public:
+    /**
+     * 把参数转发给核心组件的构造函数。单个 Decorated 参数不匹配这里，交给拷贝/移动构造函数。
+     */
+    template <typename... Args, typename = std::enable_if_t<!kIsSelf<Args...>>>
+    explicit Decorated(Args&&... args) : core_(std::forward<Args>(args)...)
+    {}
+
+    std::string Operation() const override
+    {
+        return this->Render();
+    }
+    std::size_t RenderedSize() const override
+    {
+        return kDecorationSize + core_.Core::RenderedSize();
+    }
+    char* RenderTo(char* out) const override
+    {
+        out = WritePrefixes(out, std::index_sequence_for<Layers...>());
+        out = core_.Core::RenderTo(out);
+        return WriteSuffixes(out);
+    }
 };
+
 /**
  * 客户端代码使用组件接口处理所有对象。这样，它可以独立于它所处理的具体组件类。
  */
@@ -81,8 +233,86 @@ void ClientCode(Component* component)
     // ...
 }
 
-int main()
+/**
+ * 在深度 1、10、100、1000 的装饰栈上对比 Operation() 与单次渲染 Render()。
+ */
+void BenchmarkRender()
+{
+    for (std::size_t depth: {1, 10, 100, 1000}) {
+        ConcreteComponent component;
+        std::vector<std::unique_ptr<Component>> stack;
+        Component* top = &component;
+        for (std::size_t i = 0; i < depth; ++i) {
+            if (i % 2 == 0)
+                stack.push_back(std::make_unique<ConcreteDecoratorA>(top));
+            else
+                stack.push_back(std::make_unique<ConcreteDecoratorB>(top));
+            top = stack.back().get();
+        }
+        std::size_t repeat = 200000 / depth;
+        auto time = [&](auto render) {
+            // volatile 防止编译器把结果未被使用的调用优化掉。
+            static volatile std::size_t bytes = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < repeat; ++i) bytes = bytes + render().size();
+            return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                   double(repeat);
+        };
+        double operation_ns = time([&] { return top->Operation(); });
+        double render_ns = time([&] { return top->Render(); });
+        std::cout << "depth " << depth << ": Operation() " << operation_ns << " ns, Render() " << render_ns
+                  << " ns, speedup " << operation_ns / render_ns << "x, identical " << std::boolalpha
+                  << (top->Operation() == top->Render()) << "\n";
+    }
+}
+
+/**
+ * 对比编译期组合的装饰栈与运行时用指针串起来的装饰栈。
+ */
+void BenchmarkStaticDecorators(std::size_t calls = 2000000)
+{
+    auto time = [calls](const char* name, const Component& component) {
+        static volatile std::size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < calls; ++i) bytes = bytes + component.Operation().size();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::cout << name << ": " << ns / calls << " ns/call\n";
+        return component.Operation();
+    };
+
+    ConcreteComponent simple;
+    ConcreteDecoratorA decorator1(&simple);
+    ConcreteDecoratorB decorator2(&decorator1);
+    Decorated<ConcreteComponent, StaticDecoratorA, StaticDecoratorB> decorated;
+    std::string runtime = time("depth 2, pointer chain ", decorator2);
+    std::string compile_time = time("depth 2, Decorated<...>", decorated);
+    std::cout << "identical " << std::boolalpha << (runtime == compile_time) << "\n";
+
+    std::vector<std::unique_ptr<Component>> stack;
+    Component* top = &simple;
+    for (int i = 0; i < 8; ++i) {
+        if (i % 2 == 0)
+            stack.push_back(std::make_unique<ConcreteDecoratorA>(top));
+        else
+            stack.push_back(std::make_unique<ConcreteDecoratorB>(top));
+        top = stack.back().get();
+    }
+    Decorated<ConcreteComponent, StaticDecoratorA, StaticDecoratorB, StaticDecoratorA, StaticDecoratorB,
+              StaticDecoratorA, StaticDecoratorB, StaticDecoratorA, StaticDecoratorB>
+            decorated8;
+    runtime = time("depth 8, pointer chain ", *top);
+    compile_time = time("depth 8, Decorated<...>", decorated8);
+    std::cout << "identical " << std::boolalpha << (runtime == compile_time) << "\n";
+}
+
+int main(int argc, char* argv[])
 {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        BenchmarkRender();
+        BenchmarkStaticDecorators();
+        return 0;
+    }
+
     // 这样客户端代码可以支持两个简单的组件...
     Component* simple = new ConcreteComponent;
     std::cout << "Client: I've got a simple component:\n";
@@ -95,6 +325,12 @@ int main()
     std::cout << "Client: Now I've got a decorated component:\n";
     ClientCode(decorator2);
     std::cout << "\n";
+    std::cout << "Client: Rendering the same stack in a single pass:\n";
+    std::cout << "RESULT: " << decorator2->Render() << "\n";
+    std::cout << "Client: The same stack composed at compile time:\n";
+    Decorated<ConcreteComponent, StaticDecoratorA, StaticDecoratorB> decorated;
+    ClientCode(&decorated);
+    std::cout << "\n";
 
     delete simple;
     delete decorator1;
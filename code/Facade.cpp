@@ -2,41 +2,377 @@
 // Created by Listening on 2023/4/10.
 // Facade 外观模式
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 /**
  * 子系统可以直接接受来自外观或客户端的请求。无论如何，对于子系统来说，外观是另一个客户端，它不是子系统的一部分。
  */
 class Subsystem1 {
+private:
+    std::chrono::microseconds latency_;
+    std::vector<char> cache_;
+    mutable std::mutex connection_;
+
+    void RoundTrip(std::chrono::microseconds cost) const
+    {
+        if (cost.count() == 0)
+            return;
+        std::lock_guard<std::mutex> lock(connection_);
+        std::this_thread::sleep_for(cost);
+    }
+
 public:
+    /**
+     * latency 用来模拟缓慢的子系统操作，cache_bytes 用来模拟构造时的预热开销（加载索引、建立连接等）。
+     * 子系统只有一条连接，调用串行执行；批量接口一次往返处理 count 个请求。
+     */
+    explicit Subsystem1(std::chrono::microseconds latency = {}, std::size_t cache_bytes = 0)
+        : latency_(latency), cache_(cache_bytes)
+    {
+        for (std::size_t i = 0; i < cache_.size(); ++i) cache_[i] = static_cast<char>(i * 31);
+    }
+
     std::string Operation1() const
     {
+        RoundTrip(latency_);
         return "Subsystem1: Ready!\n";
     }
+    std::vector<std::string> Operation1(std::size_t count) const
+    {
+        RoundTrip(latency_);
+        return std::vector<std::string>(count, "Subsystem1: Ready!\n");
+    }
     // ...
     std::string OperationN() const
     {
+        RoundTrip(latency_ / 2);
         return "Subsystem1: Go!\n";
     }
+    std::vector<std::string> OperationN(std::size_t count) const
+    {
+        RoundTrip(latency_ / 2);
+        return std::vector<std::string>(count, "Subsystem1: Go!\n");
+    }
 };
 /**
  * 一些外观可以同时与多个子系统一起工作。
  */
 class Subsystem2 {
+private:
+    std::chrono::microseconds latency_;
+    std::vector<char> cache_;
+    mutable std::mutex connection_;
+
+    void RoundTrip(std::chrono::microseconds cost) const
+    {
+        if (cost.count() == 0)
+            return;
+        std::lock_guard<std::mutex> lock(connection_);
+        std::this_thread::sleep_for(cost);
+    }
+
 public:
+    explicit Subsystem2(std::chrono::microseconds latency = {}, std::size_t cache_bytes = 0)
+        : latency_(latency), cache_(cache_bytes)
+    {
+        for (std::size_t i = 0; i < cache_.size(); ++i) cache_[i] = static_cast<char>(i * 31);
+    }
+
     std::string Operation1() const
     {
+        RoundTrip(latency_);
         return "Subsystem2: Get ready!\n";
     }
+    std::vector<std::string> Operation1(std::size_t count) const
+    {
+        RoundTrip(latency_);
+        return std::vector<std::string>(count, "Subsystem2: Get ready!\n");
+    }
     // ...
     std::string OperationZ() const
     {
+        RoundTrip(latency_ / 2);
         return "Subsystem2: Fire!\n";
     }
+    std::vector<std::string> OperationZ(std::size_t count) const
+    {
+        RoundTrip(latency_ / 2);
+        return std::vector<std::string>(count, "Subsystem2: Fire!\n");
+    }
+};
+
+/**
+ * 简单的固定大小线程池。
+ */
+class ThreadPool {
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::queue<std::function<void()>> tasks_;
+    std::vector<std::thread> workers_;
+    bool stop_ = false;
+
+public:
+    explicit ThreadPool(std::size_t threads = std::max(2u, std::thread::hardware_concurrency()))
+    {
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] {
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        ready_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                        if (stop_ && tasks_.empty())
+                            return;
+                        task = std::move(tasks_.front());
+                        tasks_.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        ready_.notify_all();
+        for (std::thread& worker: workers_) worker.join();
+    }
+
+    void Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push(std::move(task));
+        }
+        ready_.notify_one();
+    }
+};
+
+/**
+ * 带依赖关系的步骤图。每个步骤在其依赖全部完成后提交到线程池，互不依赖的步骤并发执行，
+ * 总耗时约等于关键路径的长度。结果按步骤的添加顺序返回，与完成顺序无关；任何一步抛出异常都会传给调用方。
+ */
+class StepGraph {
+public:
+    using Step = std::function<std::string()>;
+
+private:
+    struct Node {
+        Step step;
+        std::vector<std::size_t> dependents;
+        std::size_t dependencies = 0;
+    };
+    std::vector<Node> nodes_;
+
+    /**
+     * 一次运行的共享状态，由所有正在执行的步骤共同持有。
+     */
+    struct Run {
+        std::vector<Node> nodes;
+        std::vector<std::string> results;
+        std::unique_ptr<std::atomic<std::size_t>[]> pending;
+        std::atomic<std::size_t> remaining;
+        std::atomic<bool> failed{false};
+        std::promise<std::vector<std::string>> promise;
+        ThreadPool* pool;
+    };
+
+    static void Execute(const std::shared_ptr<Run>& run, std::size_t index)
+    {
+        run->pool->Submit([run, index] {
+            if (!run->failed.load()) {
+                try {
+                    run->results[index] = run->nodes[index].step();
+                }
+                catch (...) {
+                    if (!run->failed.exchange(true))
+                        run->promise.set_exception(std::current_exception());
+                }
+            }
+            for (std::size_t dependent: run->nodes[index].dependents) {
+                if (run->pending[dependent].fetch_sub(1) == 1)
+                    Execute(run, dependent);
+            }
+            if (run->remaining.fetch_sub(1) == 1 && !run->failed.load())
+                run->promise.set_value(std::move(run->results));
+        });
+    }
+
+public:
+    /**
+     * 添加一个步骤，dependencies 是此前添加的步骤的编号。返回新步骤的编号。
+     */
+    std::size_t Add(Step step, std::vector<std::size_t> dependencies = {})
+    {
+        std::size_t index = nodes_.size();
+        for (std::size_t dependency: dependencies) {
+            if (dependency >= index)
+                throw std::invalid_argument("StepGraph: a step may only depend on earlier steps");
+            nodes_[dependency].dependents.push_back(index);
+        }
+        nodes_.push_back(Node{std::move(step), {}, dependencies.size()});
+        return index;
+    }
+
+    std::future<std::vector<std::string>> Start(ThreadPool& pool) const
+    {
+        auto run = std::make_shared<Run>();
+        run->nodes = nodes_;
+        run->results.resize(nodes_.size());
+        run->pending.reset(new std::atomic<std::size_t>[nodes_.size()]);
+        for (std::size_t i = 0; i < nodes_.size(); ++i) run->pending[i] = nodes_[i].dependencies;
+        run->remaining = nodes_.size();
+        run->pool = &pool;
+        std::future<std::vector<std::string>> future = run->promise.get_future();
+        if (nodes_.empty())
+            run->promise.set_value({});
+        for (std::size_t i = 0; i < nodes_.size(); ++i) {
+            if (nodes_[i].dependencies == 0)
+                Execute(run, i);
+        }
+        return future;
+    }
+};
+
+/**
+ * 有界的子系统对象池。预热好的实例在多个外观之间复用，池中最多存在 capacity 个实例，
+ * 全部借出时 Acquire() 阻塞等待归还。Release() 先调用 reset 钩子清理请求相关状态，
+ * 再用 healthy 钩子检查实例，不健康的实例被销毁，下次 Acquire() 时重新创建。
+ * 池拥有它创建的每一个实例（包括借出中的），析构时全部释放，借用者不能比池活得更久。
+ * 空闲列表和所有权列表都预先分配好容量，所以借出和归还都不分配内存。
+ */
+template <typename T>
+class SubsystemPool {
+public:
+    struct Hooks {
+        std::function<T*()> create = [] { return new T; };
+        std::function<bool(const T&)> healthy = [](const T&) { return true; };
+        std::function<void(T&)> reset = [](T&) {};
+    };
+
+private:
+    std::mutex mutex_;
+    std::condition_variable released_;
+    std::vector<T*> idle_;
+    std::vector<std::unique_ptr<T>> owned_; // 已创建的全部实例
+    std::size_t capacity_;
+    std::size_t live_ = 0; // 已创建或正在创建的实例数
+    Hooks hooks_;
+
+public:
+    explicit SubsystemPool(std::size_t capacity, Hooks hooks = {}) : capacity_(capacity), hooks_(std::move(hooks))
+    {
+        if (capacity == 0)
+            throw std::invalid_argument("SubsystemPool: capacity must be positive");
+        idle_.reserve(capacity);
+        owned_.reserve(capacity);
+    }
+    SubsystemPool(const SubsystemPool&) = delete;
+    SubsystemPool& operator=(const SubsystemPool&) = delete;
+
+    /**
+     * 预先创建实例，直到池中有 count 个（不超过容量）。
+     */
+    void Warm(std::size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (live_ < std::min(count, capacity_)) {
+            owned_.emplace_back(hooks_.create());
+            idle_.push_back(owned_.back().get());
+            ++live_;
+        }
+    }
+
+    T* Acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this] { return !idle_.empty() || live_ < capacity_; });
+        if (!idle_.empty()) {
+            T* subsystem = idle_.back();
+            idle_.pop_back();
+            return subsystem;
+        }
+        ++live_;
+        lock.unlock();
+        std::unique_ptr<T> subsystem;
+        try {
+            subsystem.reset(hooks_.create());
+        }
+        catch (...) {
+            lock.lock();
+            --live_;
+            released_.notify_one();
+            throw;
+        }
+        lock.lock();
+        owned_.push_back(std::move(subsystem));
+        return owned_.back().get();
+    }
+
+    void Release(T* subsystem)
+    {
+        hooks_.reset(*subsystem);
+        bool healthy = hooks_.healthy(*subsystem);
+        std::unique_ptr<T> broken; // 在锁外销毁
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (healthy) {
+                idle_.push_back(subsystem);
+            }
+            else {
+                auto it = std::find_if(owned_.begin(), owned_.end(),
+                                       [subsystem](const std::unique_ptr<T>& owned) {
+                                           return owned.get() == subsystem;
+                                       });
+                broken = std::move(*it);
+                *it = std::move(owned_.back());
+                owned_.pop_back();
+                --live_;
+            }
+        }
+        released_.notify_one();
+    }
+
+    std::size_t Idle()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return idle_.size();
+    }
 };
 
+/**
+ * 把各子系统的输出拼成外观的结果。同步、异步和批处理三条路径共用，保证它们返回完全相同的字符串。
+ */
+std::string FacadeResult(std::string_view ready1, std::string_view ready2, std::string_view go, std::string_view fire)
+{
+    static constexpr std::string_view kInitialize = "Facade initializes subsystems:\n";
+    static constexpr std::string_view kPerform = "Facade orders subsystems to perform the action:\n";
+    std::string result;
+    result.reserve(kInitialize.size() + ready1.size() + ready2.size() + kPerform.size() + go.size() + fire.size());
+    result.append(kInitialize).append(ready1).append(ready2);
+    result.append(kPerform).append(go).append(fire);
+    return result;
+}
+
 /**
  * Facade 类为一个或多个子系统的复杂逻辑提供了一个简单的接口。外观将客户端请求委托给子系统中的相应对象。
  * 外观还负责管理其生命周期。所有这些都保护客户端免受子系统不希望出现的复杂性。
@@ -45,6 +381,14 @@ class Facade {
 protected:
     Subsystem1* subsystem1_;
     Subsystem2* subsystem2_;
+    SubsystemPool<Subsystem1>* pool1_ = nullptr;
+    SubsystemPool<Subsystem2>* pool2_ = nullptr;
+    /**
+     * 尚未结束的 OperationAsync() 个数。析构函数等它归零后才释放或归还子系统。
+     */
+    std::mutex async_mutex_;
+    std::condition_variable async_done_;
+    std::size_t async_outstanding_ = 0;
     /**
      * 根据应用程序的需要，可以为外观提供现有的子系统对象，也可以强制外观自行创建它们。
      */
@@ -58,26 +402,201 @@ public:
         this->subsystem1_ = subsystem1 ?: new Subsystem1;
         this->subsystem2_ = subsystem2 ?: new Subsystem2;
     }
+    /**
+     * 从池中借用子系统，析构时归还而不是删除。外观本身可以放在栈上，整个创建和销毁过程不分配内存。
+     */
+    Facade(SubsystemPool<Subsystem1>& pool1, SubsystemPool<Subsystem2>& pool2) : pool1_(&pool1), pool2_(&pool2)
+    {
+        this->subsystem1_ = pool1.Acquire();
+        try {
+            this->subsystem2_ = pool2.Acquire();
+        }
+        catch (...) {
+            pool1.Release(this->subsystem1_);
+            throw;
+        }
+    }
     ~Facade()
     {
-        delete subsystem1_;
-        delete subsystem2_;
+        {
+            std::unique_lock<std::mutex> lock(async_mutex_);
+            async_done_.wait(lock, [this] { return async_outstanding_ == 0; });
+        }
+        if (pool1_)
+            pool1_->Release(subsystem1_);
+        else
+            delete subsystem1_;
+        if (pool2_)
+            pool2_->Release(subsystem2_);
+        else
+            delete subsystem2_;
     }
+    Facade(const Facade&) = delete;
+    Facade& operator=(const Facade&) = delete;
     /**
      * 外观的方法是通往子系统复杂功能的方便捷径。但是，客户端只能获得子系统功能的一小部分功能。
      */
     std::string Operation()
     {
-        std::string result = "Facade initializes subsystems:\n";
-        result += this->subsystem1_->Operation1();
-        result += this->subsystem2_->Operation1();
-        result += "Facade orders subsystems to perform the action:\n";
-        result += this->subsystem1_->OperationN();
-        result += this->subsystem2_->OperationZ();
+        std::string ready1 = this->subsystem1_->Operation1();
+        std::string ready2 = this->subsystem2_->Operation1();
+        return FacadeResult(ready1, ready2, this->subsystem1_->OperationN(), this->subsystem2_->OperationZ());
+    }
+    /**
+     * 异步版本：声明各步骤之间的依赖，子系统各自的初始化并发进行，每个子系统的动作只等待自己的初始化。
+     * 最后一个步骤依赖全部四个步骤，在线程池中拼出结果并兑现返回的 future，调用方不参与任何计算。
+     * 返回的结果与 Operation() 完全相同；任何一步抛出的异常都会传给返回的 future。
+     * 步骤只捕获子系统指针和共享的结果状态，不捕获外观本身；外观析构时会等所有步骤都结束后
+     * 才释放子系统，所以调用方可以在 future 就绪之前销毁外观。
+     */
+    std::future<std::string> OperationAsync(ThreadPool& pool)
+    {
+        // 结果状态随最后一个步骤一起销毁，那时不会再有步骤访问子系统，于是通知外观这次操作已经结束。
+        struct Outputs {
+            std::string parts[4];
+            std::promise<std::string> promise;
+            std::atomic<bool> failed{false};
+            Facade* facade;
+
+            explicit Outputs(Facade* owner) : facade(owner) {}
+            ~Outputs()
+            {
+                std::lock_guard<std::mutex> lock(facade->async_mutex_);
+                --facade->async_outstanding_;
+                facade->async_done_.notify_all();
+            }
+        };
+        {
+            std::lock_guard<std::mutex> lock(async_mutex_);
+            ++async_outstanding_;
+        }
+        auto outputs = std::make_shared<Outputs>(this);
+        // 每个步骤把输出写进 outputs；失败时由第一个失败的步骤兑现异常，之后的步骤（包括最后一步）不再执行。
+        auto part = [outputs](std::size_t index, std::function<std::string()> call) {
+            return [outputs, index, call = std::move(call)] {
+                try {
+                    outputs->parts[index] = call();
+                }
+                catch (...) {
+                    if (!outputs->failed.exchange(true))
+                        outputs->promise.set_exception(std::current_exception());
+                    throw;
+                }
+                return std::string();
+            };
+        };
+        Subsystem1* subsystem1 = this->subsystem1_;
+        Subsystem2* subsystem2 = this->subsystem2_;
+        StepGraph graph;
+        std::size_t init1 = graph.Add(part(0, [subsystem1] { return subsystem1->Operation1(); }));
+        std::size_t init2 = graph.Add(part(1, [subsystem2] { return subsystem2->Operation1(); }));
+        std::size_t go = graph.Add(part(2, [subsystem1] { return subsystem1->OperationN(); }), {init1});
+        std::size_t fire = graph.Add(part(3, [subsystem2] { return subsystem2->OperationZ(); }), {init2});
+        graph.Add(
+                [outputs] {
+                    std::string* parts = outputs->parts;
+                    outputs->promise.set_value(FacadeResult(parts[0], parts[1], parts[2], parts[3]));
+                    return std::string();
+                },
+                {init1, init2, go, fire});
+        std::future<std::string> result = outputs->promise.get_future();
+        graph.Start(pool);
         return result;
     }
 };
 
+/**
+ * 批处理外观前端。并发调用者提交的请求先进入队列，后台线程在 window 时间内（或攒满 max_batch 个后）
+ * 把它们合并成每个子系统的一次批量调用，再把结果逐个分发回各自的调用者。
+ * 子系统调用有固定的往返开销时，合并后吞吐量随并发数增长，代价是单个请求最多多等一个窗口。
+ */
+class BatchingFacade {
+private:
+    const Subsystem1& subsystem1_;
+    const Subsystem2& subsystem2_;
+    std::chrono::microseconds window_;
+    std::size_t max_batch_;
+    std::mutex mutex_;
+    std::condition_variable arrived_;
+    std::vector<std::promise<std::string>> queue_;
+    bool stop_ = false;
+    std::thread dispatcher_;
+
+    void Dispatch()
+    {
+        std::vector<std::promise<std::string>> batch;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                arrived_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                arrived_.wait_until(lock, std::chrono::steady_clock::now() + window_,
+                                    [this] { return stop_ || queue_.size() >= max_batch_; });
+                std::size_t count = std::min(queue_.size(), max_batch_);
+                batch.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.begin() + count));
+                queue_.erase(queue_.begin(), queue_.begin() + count);
+            }
+            try {
+                std::vector<std::string> ready1 = subsystem1_.Operation1(batch.size());
+                std::vector<std::string> ready2 = subsystem2_.Operation1(batch.size());
+                std::vector<std::string> go = subsystem1_.OperationN(batch.size());
+                std::vector<std::string> fire = subsystem2_.OperationZ(batch.size());
+                for (std::size_t i = 0; i < batch.size(); ++i)
+                    batch[i].set_value(FacadeResult(ready1[i], ready2[i], go[i], fire[i]));
+            }
+            catch (...) {
+                for (std::promise<std::string>& caller: batch) caller.set_exception(std::current_exception());
+            }
+            batch.clear();
+        }
+    }
+
+public:
+    BatchingFacade(const Subsystem1& subsystem1, const Subsystem2& subsystem2,
+                   std::chrono::microseconds window = std::chrono::microseconds(200), std::size_t max_batch = 64)
+        : subsystem1_(subsystem1), subsystem2_(subsystem2), window_(window),
+          max_batch_(std::max<std::size_t>(1, max_batch))
+    {
+        dispatcher_ = std::thread([this] { Dispatch(); });
+    }
+    ~BatchingFacade()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        arrived_.notify_all();
+        dispatcher_.join();
+    }
+    BatchingFacade(const BatchingFacade&) = delete;
+    BatchingFacade& operator=(const BatchingFacade&) = delete;
+
+    std::future<std::string> OperationAsync()
+    {
+        std::promise<std::string> caller;
+        std::future<std::string> result = caller.get_future();
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stop_)
+                throw std::runtime_error("BatchingFacade: shutting down");
+            queue_.push_back(std::move(caller));
+            full = queue_.size() == 1 || queue_.size() >= max_batch_;
+        }
+        if (full)
+            arrived_.notify_one();
+        return result;
+    }
+    /**
+     * 与 Facade::Operation() 返回相同的结果。
+     */
+    std::string Operation()
+    {
+        return OperationAsync().get();
+    }
+};
+
 /**
  * 客户端代码通过外观提供的简单接口处理复杂的子系统。当外观管理子系统的生命周期时，客户端甚至可能不知道子系统的存在。此方法可让您控制复杂性。
  */
@@ -88,16 +607,143 @@ void ClientCode(Facade* facade)
     // ...
 }
 
+/**
+ * 用模拟的慢子系统测量顺序执行与按依赖并发执行的总耗时。
+ */
+void BenchmarkAsyncFacade()
+{
+    using std::chrono::milliseconds;
+    ThreadPool pool(4);
+    Facade facade(new Subsystem1(milliseconds(100)), new Subsystem2(milliseconds(160)));
+    auto start = std::chrono::steady_clock::now();
+    std::string sequential = facade.Operation();
+    auto sequential_ms = std::chrono::duration_cast<milliseconds>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    std::string parallel = facade.OperationAsync(pool).get();
+    auto parallel_ms = std::chrono::duration_cast<milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "sequential " << sequential_ms << " ms (sum of steps 100+160+50+80 = 390 ms)\n";
+    std::cout << "parallel   " << parallel_ms << " ms (critical path 160+80 = 240 ms), identical " << std::boolalpha
+              << (sequential == parallel) << "\n";
+}
+
+/**
+ * 每个请求创建一个短生命周期的外观，比较每次新建子系统与从池中借用预热实例的吞吐量。
+ */
+void BenchmarkPooledFacade()
+{
+    constexpr std::size_t kCacheBytes = 16 << 10;
+    constexpr int kRequests = 100000;
+    std::size_t checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRequests; ++i) {
+        Facade facade(new Subsystem1({}, kCacheBytes), new Subsystem2({}, kCacheBytes));
+        checksum += facade.Operation().size();
+    }
+    std::chrono::duration<double> fresh = std::chrono::steady_clock::now() - start;
+
+    SubsystemPool<Subsystem1>::Hooks hooks1;
+    hooks1.create = [] { return new Subsystem1({}, kCacheBytes); };
+    SubsystemPool<Subsystem2>::Hooks hooks2;
+    hooks2.create = [] { return new Subsystem2({}, kCacheBytes); };
+    SubsystemPool<Subsystem1> pool1(4, hooks1);
+    SubsystemPool<Subsystem2> pool2(4, hooks2);
+    pool1.Warm(4);
+    pool2.Warm(4);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRequests; ++i) {
+        Facade facade(pool1, pool2);
+        checksum += facade.Operation().size();
+    }
+    std::chrono::duration<double> pooled = std::chrono::steady_clock::now() - start;
+
+    std::cout << "new/delete subsystems " << kRequests / fresh.count() / 1e3 << " k facades/s\n";
+    std::cout << "pooled subsystems     " << kRequests / pooled.count() / 1e3 << " k facades/s (checksum " << checksum
+              << ")\n";
+}
+
+/**
+ * 不同并发数下直接调用与批处理调用的吞吐量和平均延迟。子系统每次调用有 200us 的往返开销。
+ */
+void BenchmarkBatchingFacade()
+{
+    using namespace std::chrono;
+    Subsystem1 subsystem1(microseconds(200));
+    Subsystem2 subsystem2(microseconds(200));
+    constexpr int kCallsPerThread = 40;
+
+    auto run = [](int threads, const std::function<std::string()>& call) {
+        std::atomic<long long> latency_ns{0};
+        auto start = steady_clock::now();
+        std::vector<std::thread> callers;
+        for (int t = 0; t < threads; ++t) {
+            callers.emplace_back([&] {
+                for (int i = 0; i < kCallsPerThread; ++i) {
+                    auto begin = steady_clock::now();
+                    call();
+                    latency_ns += duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+                }
+            });
+        }
+        for (std::thread& caller: callers) caller.join();
+        double seconds = duration<double>(steady_clock::now() - start).count();
+        double calls = double(threads) * kCallsPerThread;
+        std::cout << std::setw(10) << calls / seconds << " calls/s, " << std::setw(8) << latency_ns / calls / 1e3
+                  << " us/call";
+    };
+
+    Facade direct(new Subsystem1(microseconds(200)), new Subsystem2(microseconds(200)));
+    BatchingFacade batching(subsystem1, subsystem2, microseconds(200), 64);
+    std::cout << std::fixed << std::setprecision(0);
+    for (int threads: {1, 4, 16, 64}) {
+        std::cout << std::setw(3) << threads << " callers: direct ";
+        run(threads, [&] { return direct.Operation(); });
+        std::cout << " | batched ";
+        run(threads, [&] { return batching.Operation(); });
+        std::cout << "\n";
+    }
+    std::cout << std::defaultfloat << std::setprecision(6);
+}
+
 /**
  * 客户端代码可能已创建某些子系统的对象。在这种情况下，可能值得使用这些对象初始化外观，而不是让外观创建新实例。
  */
-int main()
+int main(int argc, char* argv[])
 {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        BenchmarkAsyncFacade();
+        BenchmarkPooledFacade();
+        BenchmarkBatchingFacade();
+        return 0;
+    }
+
     Subsystem1* subsystem1 = new Subsystem1;
     Subsystem2* subsystem2 = new Subsystem2;
 
     std::unique_ptr<Facade> facade = std::make_unique<Facade>(subsystem1, subsystem2);
     ClientCode(facade.get());
 
+    std::cout << "\nFacade can also run independent steps concurrently:\n";
+    ThreadPool pool;
+    std::cout << facade->OperationAsync(pool).get();
+
+    std::cout << "\nFacade can borrow warm subsystems from a pool:\n";
+    SubsystemPool<Subsystem1> pool1(2);
+    SubsystemPool<Subsystem2> pool2(2);
+    pool1.Warm(1);
+    pool2.Warm(1);
+    {
+        Facade pooled(pool1, pool2);
+        ClientCode(&pooled);
+    }
+    std::cout << "Idle subsystems after the request: " << pool1.Idle() << " + " << pool2.Idle() << "\n";
+
+    std::cout << "\nConcurrent callers can share batched subsystem calls:\n";
+    BatchingFacade batching(*subsystem1, *subsystem2);
+    std::future<std::string> first = batching.OperationAsync();
+    std::future<std::string> second = batching.OperationAsync();
+    std::cout << first.get() << "Second caller received the same result: " << std::boolalpha
+              << (second.get() == facade->Operation()) << "\n";
+
     return 0;
 }
\ No newline at end of file
@@ -1,14 +1,39 @@
 //
 // Created by Listening on 2022/11/14.
 // 代理模式
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 /**
  * Subject 接口声明了 RealSubject 和 Proxy 的通用操作。
  * 只要客户端使用此接口与 RealSubject 一起工作，就可以向它传递代理而不是真实的subject。
  */
 class Subject {
 public:
+    virtual ~Subject() = default;
     virtual void Request() const = 0;
 };
 /**
@@ -24,36 +49,607 @@ public:
         std::cout << "RealSubject: Handling request.\n";
     }
 };
+/**
+ * 准入控制：按客户端限速（令牌桶）并限制并发，可选地再加一个全局在途请求上限。整个检查路径不加锁。
+ *
+ * 令牌桶用 GCRA 形式实现：每个客户端只保存一个“理论到达时间” tat，补充令牌和扣减令牌合并成一次 CAS。
+ * 客户端状态存放在固定容量的开放寻址表中，槽位的 key 通过 CAS 占用，因此查找和插入同样无锁。
+ */
+class AdmissionControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Limits {
+        double rate_per_second = 1000; // 每个客户端的令牌补充速率
+        double burst = 100; // 令牌桶容量
+        int max_concurrent_per_client = 0; // 每个客户端的在途请求上限，0 表示不限
+        int max_in_flight = 0; // 全局在途请求上限，0 表示不限
+    };
+
+    /**
+     * 每个客户端的状态，独占一个缓存行以避免不同客户端之间的伪共享。
+     */
+    struct alignas(64) Client {
+        std::atomic<std::uint64_t> id{kEmpty};
+        std::atomic<std::int64_t> tat{0};
+        std::atomic<int> in_flight{0};
+    };
+
+private:
+    static constexpr std::uint64_t kEmpty = 0;
+
+    std::int64_t interval_;
+    std::int64_t tolerance_;
+    Limits limits_;
+    std::vector<Client> clients_;
+    std::atomic<int> in_flight_{0};
+
+    static std::int64_t Nanoseconds(Clock::time_point now)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    }
+
+public:
+    /**
+     * capacity 会向上取整到 2 的幂；客户端数超过容量时 Find() 返回 nullptr。
+     * 速率以纳秒为粒度，必须在 (0, 1e9] 之内，burst 至少为 1，否则抛出 std::invalid_argument。
+     */
+    explicit AdmissionControl(Limits limits, std::size_t capacity = 4096) : limits_(limits)
+    {
+        if (!(limits.rate_per_second > 0 && limits.rate_per_second <= 1e9))
+            throw std::invalid_argument("AdmissionControl: rate_per_second must be in (0, 1e9]");
+        if (!(limits.burst >= 1 && limits.burst <= 1e9))
+            throw std::invalid_argument("AdmissionControl: burst must be in [1, 1e9]");
+        double interval = 1e9 / limits.rate_per_second;
+        if (interval * limits.burst > 9e18)
+            throw std::invalid_argument("AdmissionControl: rate_per_second too small for this burst");
+        interval_ = static_cast<std::int64_t>(interval);
+        tolerance_ = static_cast<std::int64_t>(interval * limits.burst);
+        std::size_t size = 1;
+        while (size < capacity) size <<= 1;
+        clients_ = std::vector<Client>(size);
+    }
+
+    /**
+     * 查找或登记客户端。client_id 0 保留，传入时抛出 std::invalid_argument。
+     */
+    Client* Find(std::uint64_t client_id)
+    {
+        if (client_id == kEmpty)
+            throw std::invalid_argument("AdmissionControl: client id 0 is reserved");
+        std::size_t mask = clients_.size() - 1;
+        std::size_t index = (client_id * 0x9E3779B97F4A7C15ull) >> 32 & mask;
+        for (std::size_t probe = 0; probe < clients_.size(); ++probe, index = (index + 1) & mask) {
+            Client& client = clients_[index];
+            std::uint64_t id = client.id.load(std::memory_order_acquire);
+            if (id == client_id)
+                return &client;
+            if (id == kEmpty && client.id.compare_exchange_strong(id, client_id, std::memory_order_acq_rel))
+                return &client;
+            // CAS 失败时 id 是抢先占用该槽位的客户端，可能正是我们自己。
+            if (id == client_id)
+                return &client;
+        }
+        return nullptr;
+    }
+
+    /**
+     * 成功时占用一个令牌和一个在途名额，调用方在请求结束后必须调用 Release()。
+     * 先占并发名额再扣令牌：被并发上限拒绝的请求不消耗速率额度，被限速拒绝时归还已占的名额。
+     */
+    bool TryAdmit(Client& client, Clock::time_point now = Clock::now())
+    {
+        if (limits_.max_concurrent_per_client > 0 &&
+            client.in_flight.fetch_add(1, std::memory_order_relaxed) >= limits_.max_concurrent_per_client) {
+            client.in_flight.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (limits_.max_in_flight > 0 && in_flight_.fetch_add(1, std::memory_order_relaxed) >= limits_.max_in_flight) {
+            in_flight_.fetch_sub(1, std::memory_order_relaxed);
+            if (limits_.max_concurrent_per_client > 0)
+                client.in_flight.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::int64_t t = Nanoseconds(now);
+        std::int64_t tat = client.tat.load(std::memory_order_relaxed);
+        for (;;) {
+            std::int64_t next = std::max(tat, t) + interval_;
+            if (next - t > tolerance_) {
+                Release(client);
+                return false;
+            }
+            if (client.tat.compare_exchange_weak(tat, next, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    void Release(Client& client)
+    {
+        if (limits_.max_concurrent_per_client > 0)
+            client.in_flight.fetch_sub(1, std::memory_order_relaxed);
+        if (limits_.max_in_flight > 0)
+            in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * 审计日志的定长二进制记录。
+ */
+struct AuditRecord {
+    std::int64_t timestamp_ns; // 请求开始的墙钟时间（自 Unix 纪元起的纳秒）
+    std::uint64_t client; // 客户端 id，未设置准入控制时为 0
+    std::uint32_t op; // 操作码，见 AuditLog::Op
+    std::uint32_t latency_ns; // 请求耗时，超过 UINT32_MAX（约 4.29 秒）时饱和为 UINT32_MAX
+};
+
+/**
+ * 日志文件头。文件由若干段组成，每段是一个 kHeaderSize 字节的头加上 count 条 AuditRecord。
+ */
+struct AuditFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint64_t count;
+};
+
+/**
+ * 审计日志：请求路径只把一条定长记录写进当前线程自己的无锁单生产者单消费者环形缓冲区，
+ * 由后台线程定期把所有缓冲区搬到内存映射的日志文件里，文件写满后轮转到下一个文件。
+ *
+ * 不丢记录：缓冲区满时生产者会让出 CPU 等待后台线程腾出空间，而不是丢弃记录。
+ * 只要 ring_capacity 能容纳每个线程在一个 drain_interval 内产生的记录，请求路径就不会等待。
+ */
+class AuditLog {
+public:
+    enum Op : std::uint32_t { kRequest = 1 };
+
+    static constexpr char kMagic[8] = {'P', 'X', 'A', 'U', 'D', 'I', 'T', '1'};
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::size_t kHeaderSize = 64;
+
+    struct Options {
+        std::filesystem::path path; // 日志文件为 path.0、path.1 ……
+        std::size_t records_per_file = 1 << 20;
+        std::size_t max_files = 4; // overwrite_oldest 时最多保留的文件数
+        std::size_t ring_capacity = 1 << 14; // 每个线程缓冲区的记录数，向上取整到 2 的幂
+        std::chrono::milliseconds drain_interval{1};
+        // true：在 max_files 个文件之间循环，覆盖最旧的文件，被覆盖的记录数见 Overwritten()；
+        // false：从不覆盖，跳过已存在的文件，一直写到新的 path.N。
+        bool overwrite_oldest = true;
+    };
+
+private:
+    struct Ring {
+        explicit Ring(std::size_t capacity) : records(capacity) {}
+
+        alignas(64) std::atomic<std::size_t> head{0};
+        alignas(64) std::atomic<std::size_t> tail{0};
+        std::vector<AuditRecord> records;
+    };
+
+    Options options_;
+    std::size_t id_;
+    std::int64_t wall_offset_ns_;
+
+    std::mutex rings_mutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+
+    // 以下成员只由后台线程访问。
+    int fd_ = -1;
+    char* map_ = nullptr;
+    std::size_t map_size_ = 0;
+    std::size_t file_index_ = 0;
+    std::size_t file_count_ = 0;
+
+    std::atomic<bool> stop_{false};
+    std::atomic<std::uint64_t> written_{0};
+    std::atomic<std::uint64_t> stalls_{0};
+    std::atomic<std::uint64_t> overwritten_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    mutable std::mutex error_mutex_;
+    std::string error_;
+    std::thread drainer_;
+
+    static std::size_t NextId()
+    {
+        static std::atomic<std::size_t> next{1};
+        return next.fetch_add(1);
+    }
+
+    /**
+     * 每个线程缓存它在最近一次使用的 AuditLog 里的缓冲区，首次使用时才加锁登记。
+     */
+    Ring& ThreadRing()
+    {
+        thread_local std::size_t cached_id = 0;
+        thread_local Ring* cached_ring = nullptr;
+        if (cached_id == id_)
+            return *cached_ring;
+
+        thread_local std::unordered_map<std::size_t, Ring*> rings;
+        Ring*& ring = rings[id_];
+        if (ring == nullptr) {
+            std::size_t capacity = 1;
+            while (capacity < options_.ring_capacity) capacity <<= 1;
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings_.push_back(std::make_unique<Ring>(capacity));
+            ring = rings_.back().get();
+        }
+        cached_id = id_;
+        cached_ring = ring;
+        return *ring;
+    }
+
+    AuditFileHeader& Header()
+    {
+        return *reinterpret_cast<AuditFileHeader*>(map_);
+    }
+
+    std::filesystem::path FilePath() const
+    {
+        std::filesystem::path path = options_.path;
+        path += "." + std::to_string(file_index_);
+        return path;
+    }
+
+    void OpenFile()
+    {
+        std::filesystem::path path = FilePath();
+        if (options_.overwrite_oldest) {
+            fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd_ < 0)
+                throw std::system_error(errno, std::generic_category(), "AuditLog: open " + path.string());
+            // 记下被覆盖的旧记录数，覆盖不再是无声的。
+            AuditFileHeader old{};
+            if (::pread(fd_, &old, sizeof(old), 0) == static_cast<ssize_t>(sizeof(old)) &&
+                std::memcmp(old.magic, kMagic, sizeof(kMagic)) == 0)
+                overwritten_.fetch_add(old.count, std::memory_order_relaxed);
+            if (::ftruncate(fd_, 0) != 0)
+                throw std::system_error(errno, std::generic_category(), "AuditLog: ftruncate " + path.string());
+        }
+        else {
+            while ((fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644)) < 0 && errno == EEXIST) {
+                ++file_index_;
+                path = FilePath();
+            }
+            if (fd_ < 0)
+                throw std::system_error(errno, std::generic_category(), "AuditLog: open " + path.string());
+        }
+        map_size_ = kHeaderSize + options_.records_per_file * sizeof(AuditRecord);
+        if (::ftruncate(fd_, static_cast<off_t>(map_size_)) != 0)
+            throw std::system_error(errno, std::generic_category(), "AuditLog: ftruncate " + path.string());
+        void* map = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "AuditLog: mmap " + path.string());
+        map_ = static_cast<char*>(map);
+        AuditFileHeader& header = Header();
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.record_size = sizeof(AuditRecord);
+        header.count = 0;
+        file_count_ = 0;
+    }
+
+    void CloseFile()
+    {
+        if (map_ == nullptr)
+            return;
+        Header().count = file_count_;
+        ::msync(map_, map_size_, MS_ASYNC);
+        ::munmap(map_, map_size_);
+        ::close(fd_);
+        map_ = nullptr;
+        fd_ = -1;
+    }
+
+    void Rotate()
+    {
+        CloseFile();
+        file_index_ = options_.overwrite_oldest ? (file_index_ + 1) % options_.max_files : file_index_ + 1;
+        OpenFile();
+    }
+
+    /**
+     * 后台线程无法继续写文件时调用：记下错误并输出到 std::cerr，之后的记录只计数丢弃，
+     * 这样生产者不会因为缓冲区满而永远等待，进程也不会因为线程中未捕获的异常而终止。
+     */
+    void Fail(const std::exception& error)
+    {
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+        map_ = nullptr;
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (error_.empty()) {
+            error_ = error.what();
+            std::cerr << "AuditLog: stopped writing: " << error_ << "\n";
+        }
+    }
+
+    /**
+     * 把所有线程缓冲区中已提交的记录搬到日志文件，返回搬运的条数。
+     */
+    std::size_t Drain()
+    {
+        std::vector<Ring*> rings;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            for (auto& ring: rings_) rings.push_back(ring.get());
+        }
+        std::size_t drained = 0;
+        for (Ring* ring: rings) {
+            std::size_t head = ring->head.load(std::memory_order_relaxed);
+            std::size_t tail = ring->tail.load(std::memory_order_acquire);
+            std::size_t mask = ring->records.size() - 1;
+            while (head != tail) {
+                if (map_ == nullptr) {
+                    dropped_.fetch_add(tail - head, std::memory_order_relaxed);
+                    ring->head.store(tail, std::memory_order_release);
+                    break;
+                }
+                if (file_count_ == options_.records_per_file) {
+                    try {
+                        Rotate();
+                    }
+                    catch (const std::exception& error) {
+                        Fail(error);
+                        continue;
+                    }
+                }
+                std::size_t n = std::min({tail - head, ring->records.size() - (head & mask),
+                                          options_.records_per_file - file_count_});
+                std::memcpy(map_ + kHeaderSize + file_count_ * sizeof(AuditRecord), &ring->records[head & mask],
+                            n * sizeof(AuditRecord));
+                file_count_ += n;
+                head += n;
+                drained += n;
+                ring->head.store(head, std::memory_order_release);
+            }
+        }
+        if (drained != 0) {
+            if (map_ != nullptr)
+                Header().count = file_count_;
+            written_.fetch_add(drained, std::memory_order_relaxed);
+        }
+        return drained;
+    }
+
+    void Run()
+    {
+        while (!stop_.load(std::memory_order_acquire)) {
+            if (Drain() == 0)
+                std::this_thread::sleep_for(options_.drain_interval);
+        }
+        Drain();
+        CloseFile();
+    }
+
+public:
+    explicit AuditLog(Options options) : options_(std::move(options)), id_(NextId())
+    {
+        auto wall = std::chrono::system_clock::now().time_since_epoch();
+        auto steady = std::chrono::steady_clock::now().time_since_epoch();
+        wall_offset_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(wall - steady).count();
+        OpenFile();
+        drainer_ = std::thread(&AuditLog::Run, this);
+    }
+    /**
+     * 停止后台线程，并把剩余的记录全部写入文件。
+     */
+    ~AuditLog()
+    {
+        stop_.store(true, std::memory_order_release);
+        drainer_.join();
+    }
+
+    /**
+     * 请求路径：写一条记录并发布，不加锁也不做系统调用。
+     */
+    void Append(std::uint64_t client, Op op, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end)
+    {
+        Ring& ring = ThreadRing();
+        std::size_t tail = ring.tail.load(std::memory_order_relaxed);
+        if (tail - ring.head.load(std::memory_order_acquire) == ring.records.size()) {
+            stalls_.fetch_add(1, std::memory_order_relaxed);
+            while (tail - ring.head.load(std::memory_order_acquire) == ring.records.size()) std::this_thread::yield();
+        }
+        AuditRecord& record = ring.records[tail & (ring.records.size() - 1)];
+        record.timestamp_ns =
+                wall_offset_ns_ + std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+        record.client = client;
+        record.op = op;
+        std::int64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        record.latency_ns = static_cast<std::uint32_t>(std::clamp<std::int64_t>(latency, 0, UINT32_MAX));
+        ring.tail.store(tail + 1, std::memory_order_release);
+    }
+
+    std::uint64_t Written() const
+    {
+        return written_.load(std::memory_order_relaxed);
+    }
+    /**
+     * 轮转时被覆盖的旧记录数（包括启动时覆盖的上一次运行留下的文件）。
+     */
+    std::uint64_t Overwritten() const
+    {
+        return overwritten_.load(std::memory_order_relaxed);
+    }
+    /**
+     * 后台线程写文件失败后丢弃的记录数，以及失败原因；没有失败时 Error() 为空。
+     */
+    std::uint64_t Dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+    std::string Error() const
+    {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        return error_;
+    }
+    /**
+     * 生产者因缓冲区满而等待的次数，非 0 说明 ring_capacity 或 drain_interval 需要调整。
+     */
+    std::uint64_t Stalls() const
+    {
+        return stalls_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 离线解码一个日志文件，每条记录输出一行文本，返回解码出的记录条数。
+     * 文件被截断或只写了一部分时，在最后一条完整的记录处停止。
+     */
+    static std::size_t Decode(const std::filesystem::path& path, std::ostream& out)
+    {
+        std::ifstream in(path, std::ios::binary);
+        AuditFileHeader header{};
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!in || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+            header.record_size != sizeof(AuditRecord))
+            throw std::runtime_error("AuditLog: " + path.string() + " is not an audit log");
+        in.seekg(kHeaderSize);
+        std::size_t decoded = 0;
+        for (; decoded < header.count; ++decoded) {
+            AuditRecord record{};
+            in.read(reinterpret_cast<char*>(&record), sizeof(record));
+            if (!in || in.gcount() != static_cast<std::streamsize>(sizeof(record)))
+                break;
+            out << record.timestamp_ns << " client=" << record.client << " op="
+                << (record.op == kRequest ? "Request" : std::to_string(record.op)) << " latency_ns=" << record.latency_ns
+                << "\n";
+        }
+        return decoded;
+    }
+};
+
 /**
  * Proxy 具有与 RealSubject 相同的接口。
  */
 class Proxy : public Subject {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Factory = std::function<std::unique_ptr<RealSubject>()>;
+
     /**
 	 * @var RealSubject
 	 */
 private:
-    RealSubject* real_subject_;
+    /**
+     * 快路径只读这个原子指针，不加锁；慢路径（首次加载、空闲释放）由 mutex_ 串行化。
+     */
+    mutable std::atomic<RealSubject*> real_subject_{nullptr};
+    mutable std::mutex mutex_;
+    Factory factory_;
+    /**
+     * 空闲释放相关。idle_ttl_ 为 0 时不会释放，快路径也不再维护 in_flight_ 计数。
+     */
+    Clock::duration idle_ttl_{};
+    mutable std::atomic<int> in_flight_{0};
+    mutable std::atomic<Clock::rep> last_use_{0};
+    /**
+     * 准入控制，未设置时放行所有请求。客户端槽位在 SetAdmissionControl() 时查好，请求路径不再查表。
+     */
+    std::shared_ptr<AdmissionControl> admission_;
+    AdmissionControl::Client* client_ = nullptr;
+    std::uint64_t client_id_ = 0;
+    /**
+     * 审计日志，未设置时 LogAccess() 直接输出到 std::cout。
+     */
+    std::shared_ptr<AuditLog> audit_;
 
     bool CheckAccess() const
     {
+        if (client_ != nullptr)
+            return admission_->TryAdmit(*client_);
         // Some real checks should go here.
         std::cout << "Proxy: Checking access prior to firing a real request.\n";
         return true;
     }
-    void LogAccess() const
+    void LogAccess(Clock::time_point start) const
     {
+        if (audit_ != nullptr) {
+            audit_->Append(client_id_, AuditLog::kRequest, start, Clock::now());
+            return;
+        }
         std::cout << "Proxy: Logging the time of request.\n";
     }
 
+    void Touch() const
+    {
+        last_use_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    /**
+     * 双重检查：多个线程同时首次访问时，只有一个线程会真正创建 RealSubject。
+     * 新加载的 RealSubject 从此刻开始计算空闲时间，不会被 ReleaseIfIdle() 当作早已空闲而立即释放。
+     */
+    RealSubject* LoadSubject() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        RealSubject* subject = real_subject_.load(std::memory_order_acquire);
+        if (subject == nullptr) {
+            subject = factory_().release();
+            this->Touch();
+            real_subject_.store(subject, std::memory_order_release);
+        }
+        return subject;
+    }
+
     /**
 	 * Proxy 维护对 RealSubject 类对象的引用。它可以延迟加载，也可以由客户机传递给代理。
 	 */
 public:
     Proxy(RealSubject* real_subject) : real_subject_(new RealSubject(*real_subject)) {}
+    /**
+     * 虚拟代理：构造时不创建 RealSubject，直到第一次 Request() 才通过 factory 加载。
+     * idle_ttl 不为 0 时，可由 ReleaseIfIdle() 在空闲超过该时长后释放 RealSubject，下次请求时重新加载。
+     */
+    explicit Proxy(Factory factory = [] { return std::make_unique<RealSubject>(); },
+                   Clock::duration idle_ttl = Clock::duration::zero())
+        : factory_(std::move(factory)), idle_ttl_(idle_ttl)
+    {}
 
     ~Proxy()
     {
-        delete real_subject_;
+        delete real_subject_.load();
+    }
+
+    /**
+     * 提前加载 RealSubject，相当于退回到饿汉式代理。
+     */
+    void Preload() const
+    {
+        if (!this->IsLoaded())
+            this->LoadSubject();
+    }
+    bool IsLoaded() const
+    {
+        return real_subject_.load(std::memory_order_acquire) != nullptr;
+    }
+    /**
+     * 若 RealSubject 已空闲超过 idle_ttl 且没有正在进行的请求，则释放它。返回是否释放。
+     *
+     * 先把指针换成 nullptr 再复查 in_flight_：如果期间有请求进入，它要么已经拿到旧指针（此时计数非 0，
+     * 我们把指针放回去），要么读到 nullptr 进入 LoadSubject() 等待锁，之后会看到放回的指针。
+     */
+    bool ReleaseIfIdle(Clock::time_point now = Clock::now()) const
+    {
+        if (idle_ttl_ == Clock::duration::zero() || factory_ == nullptr)
+            return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (now.time_since_epoch().count() - last_use_.load(std::memory_order_relaxed) < idle_ttl_.count())
+            return false;
+        if (in_flight_.load() != 0)
+            return false;
+        RealSubject* subject = real_subject_.exchange(nullptr);
+        if (subject == nullptr)
+            return false;
+        if (in_flight_.load() != 0) {
+            real_subject_.store(subject);
+            return false;
+        }
+        delete subject;
+        return true;
     }
     /**
 	 * 代理模式最常见的应用是延迟加载、缓存、控制访问、日志记录等。
@@ -62,11 +658,422 @@ public:
     void Request() const override
     {
         if (this->CheckAccess()) {
-            this->real_subject_->Request();
-            this->LogAccess();
+            // 准入名额由作用域对象归还，Forward() 抛出异常时也不会泄漏。
+            struct Admitted {
+                AdmissionControl* admission;
+                AdmissionControl::Client* client;
+                ~Admitted()
+                {
+                    if (client != nullptr)
+                        admission->Release(*client);
+                }
+            } admitted{admission_.get(), client_};
+            Clock::time_point start = audit_ != nullptr ? Clock::now() : Clock::time_point();
+            this->Forward();
+            this->LogAccess(start);
+        }
+    }
+
+    /**
+     * 让该代理以 client_id 的身份接受准入控制。客户端表已满时抛出 std::length_error。
+     */
+    void SetAdmissionControl(std::shared_ptr<AdmissionControl> admission, std::uint64_t client_id)
+    {
+        AdmissionControl::Client* client = admission->Find(client_id);
+        if (client == nullptr)
+            throw std::length_error("AdmissionControl: client table is full");
+        admission_ = std::move(admission);
+        client_ = client;
+        client_id_ = client_id;
+    }
+    /**
+     * 把访问记录写入二进制审计日志，而不是输出到 std::cout。
+     */
+    void SetAuditLog(std::shared_ptr<AuditLog> audit)
+    {
+        audit_ = std::move(audit);
+    }
+
+private:
+    void Forward() const
+    {
+        if (idle_ttl_ == Clock::duration::zero()) {
+            RealSubject* subject = real_subject_.load(std::memory_order_acquire);
+            if (subject == nullptr)
+                subject = this->LoadSubject();
+            subject->Request();
+            return;
+        }
+        // 可释放模式下用 in_flight_ 告诉 ReleaseIfIdle() 有请求正在使用 RealSubject。
+        // 计数由作用域对象递减，加载或请求抛出异常时也不会一直停在非 0。
+        struct InFlight {
+            std::atomic<int>& count;
+            ~InFlight()
+            {
+                count.fetch_sub(1, std::memory_order_release);
+            }
+        };
+        in_flight_.fetch_add(1);
+        InFlight in_flight{in_flight_};
+        RealSubject* subject = real_subject_.load();
+        if (subject == nullptr)
+            subject = this->LoadSubject();
+        // 请求开始和结束时都记录使用时间：空闲时长从最后一次请求结束算起。
+        this->Touch();
+        subject->Request();
+        this->Touch();
+    }
+};
+/**
+ * SingleFlight 合并针对同一个 key 的并发调用：第一个到达的调用者真正执行 fn，
+ * 其余调用者等待并共享它的结果；fn 抛出的异常同样会传递给每一个等待者。
+ */
+template <typename Key, typename Value>
+class SingleFlight {
+private:
+    std::mutex mutex_;
+    std::unordered_map<Key, std::shared_future<Value>> calls_;
+
+public:
+    template <typename Fn>
+    Value Do(const Key& key, Fn&& fn)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = calls_.find(key);
+        if (it != calls_.end()) {
+            std::shared_future<Value> call = it->second;
+            lock.unlock();
+            return call.get();
+        }
+        std::promise<Value> promise;
+        std::shared_future<Value> call = promise.get_future().share();
+        calls_.emplace(key, call);
+        lock.unlock();
+
+        try {
+            if constexpr (std::is_void_v<Value>) {
+                fn();
+                promise.set_value();
+            }
+            else {
+                promise.set_value(fn());
+            }
+        }
+        catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+
+        lock.lock();
+        calls_.erase(key);
+        lock.unlock();
+        return call.get();
+    }
+};
+
+/**
+ * 合并代理：真实主体很慢时，同时到达的相同请求只会有一个穿透到真实主体，其余请求共享这一次调用。
+ */
+class CoalescingProxy : public Subject {
+private:
+    const Subject& real_subject_;
+    mutable SingleFlight<std::string, void> flight_;
+
+public:
+    explicit CoalescingProxy(const Subject& real_subject) : real_subject_(real_subject) {}
+
+    /**
+     * Subject::Request() 没有参数，所以所有并发的 Request() 都视为同一个请求。
+     */
+    void Request() const override
+    {
+        flight_.Do("Request", [this] { real_subject_.Request(); });
+    }
+};
+
+/**
+ * 远程代理的线路格式：请求帧只有一个 8 字节序号，应答帧是序号加 4 字节状态（0 成功，1 真实主体抛出异常）。
+ */
+struct RemoteRequestFrame {
+    std::uint64_t id;
+};
+struct RemoteReplyFrame {
+    std::uint64_t id;
+    std::uint32_t status;
+    std::uint32_t reserved;
+};
+
+/**
+ * 在 fd 上写完 size 字节，对端关闭时返回 false。
+ */
+inline bool SendAll(int fd, const void* data, std::size_t size)
+{
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+inline sockaddr_un UnixAddress(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::invalid_argument("Remote proxy: socket path too long: " + path);
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+/**
+ * 托管真实主体的服务端，监听一个 Unix 域套接字。每个连接由一个线程服务：一次 recv 读入所有已到达的请求，
+ * 依次调用真实主体，再用一次 send 把这一批应答全部写回，以此摊薄系统调用。
+ * 测试中可以和客户端放在同一进程里作为另一进程的替身。
+ */
+class RemoteSubjectServer {
+private:
+    const Subject& real_subject_;
+    std::string path_;
+    int listen_fd_ = -1;
+    std::thread acceptor_;
+    std::mutex mutex_;
+    std::vector<int> connections_;
+    std::vector<std::thread> workers_;
+
+    void Serve(int fd)
+    {
+        std::vector<char> in(64 * 1024);
+        std::vector<RemoteReplyFrame> replies;
+        std::size_t buffered = 0;
+        for (;;) {
+            ssize_t n = ::recv(fd, in.data() + buffered, in.size() - buffered, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            buffered += static_cast<std::size_t>(n);
+            std::size_t frames = buffered / sizeof(RemoteRequestFrame);
+            replies.clear();
+            for (std::size_t i = 0; i < frames; ++i) {
+                RemoteRequestFrame request;
+                std::memcpy(&request, in.data() + i * sizeof(request), sizeof(request));
+                RemoteReplyFrame reply{request.id, 0, 0};
+                try {
+                    real_subject_.Request();
+                }
+                catch (...) {
+                    reply.status = 1;
+                }
+                replies.push_back(reply);
+            }
+            buffered -= frames * sizeof(RemoteRequestFrame);
+            std::memmove(in.data(), in.data() + frames * sizeof(RemoteRequestFrame), buffered);
+            if (!SendAll(fd, replies.data(), replies.size() * sizeof(RemoteReplyFrame)))
+                break;
+        }
+    }
+
+    void Accept()
+    {
+        for (;;) {
+            int fd = ::accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_.push_back(fd);
+            workers_.emplace_back(&RemoteSubjectServer::Serve, this, fd);
+        }
+    }
+
+public:
+    RemoteSubjectServer(const Subject& real_subject, std::string path)
+        : real_subject_(real_subject), path_(std::move(path))
+    {
+        sockaddr_un address = UnixAddress(path_);
+        ::unlink(path_.c_str());
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0)
+            throw std::system_error(errno, std::generic_category(), "RemoteSubjectServer: socket");
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listen_fd_, 64) != 0) {
+            int error = errno;
+            ::close(listen_fd_);
+            throw std::system_error(error, std::generic_category(), "RemoteSubjectServer: bind " + path_);
+        }
+        acceptor_ = std::thread(&RemoteSubjectServer::Accept, this);
+    }
+    ~RemoteSubjectServer()
+    {
+        ::shutdown(listen_fd_, SHUT_RDWR);
+        acceptor_.join();
+        ::close(listen_fd_);
+        for (int fd: connections_) ::shutdown(fd, SHUT_RDWR);
+        for (std::thread& worker: workers_) worker.join();
+        for (int fd: connections_) ::close(fd);
+        ::unlink(path_.c_str());
+    }
+};
+
+/**
+ * 远程代理：把 Request() 编组后经 Unix 域套接字发给另一个进程中的真实主体。
+ * 同一连接上可以有任意多个未完成的请求（流水线）。请求先进入发送队列，由写线程把积攒的请求合并成一次 send，
+ * 应答由读线程按批读取并交付给对应的 future。发送失败时连接被关闭，所有未完成的请求都会失败。
+ */
+class RemoteProxy : public Subject {
+private:
+    int fd_ = -1;
+    std::thread reader_;
+    std::thread writer_;
+    mutable std::mutex send_mutex_;
+    mutable std::condition_variable send_ready_;
+    mutable std::vector<RemoteRequestFrame> outgoing_;
+    bool stopping_ = false;
+    mutable std::mutex pending_mutex_;
+    mutable std::uint64_t next_id_ = 0;
+    mutable std::deque<std::pair<std::uint64_t, std::promise<void>>> pending_;
+    bool closed_ = false;
+
+    /**
+     * 关闭连接并让所有未完成的请求以 message 失败。之后的 RequestAsync() 直接抛出异常。
+     */
+    void Fail(const std::string& message)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            closed_ = true;
+            for (auto& entry: pending_) entry.second.set_exception(std::make_exception_ptr(std::runtime_error(message)));
+            pending_.clear();
+        }
+        ::shutdown(fd_, SHUT_RDWR);
+    }
+
+    void WriteRequests()
+    {
+        std::vector<RemoteRequestFrame> batch;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(send_mutex_);
+                send_ready_.wait(lock, [this] { return stopping_ || !outgoing_.empty(); });
+                if (outgoing_.empty())
+                    return;
+                batch.swap(outgoing_);
+            }
+            // 部分发送之后应答流已经无法与请求对齐，只能整个连接作废。
+            if (!SendAll(fd_, batch.data(), batch.size() * sizeof(RemoteRequestFrame))) {
+                Fail("RemoteProxy: send failed");
+                return;
+            }
+            batch.clear();
+        }
+    }
+
+    /**
+     * 服务端按到达顺序处理同一连接上的请求，所以应答与 pending_ 的顺序一致。多出来的或编号对不上的应答
+     * 说明应答流已经错位，此时不再兑现任何 future，而是让整个连接失败。
+     */
+    void ReadReplies()
+    {
+        std::vector<char> in(64 * 1024);
+        std::size_t buffered = 0;
+        for (;;) {
+            ssize_t n = ::recv(fd_, in.data() + buffered, in.size() - buffered, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            buffered += static_cast<std::size_t>(n);
+            std::size_t frames = buffered / sizeof(RemoteReplyFrame);
+            bool unexpected = false;
+            {
+                std::lock_guard<std::mutex> lock(pending_mutex_);
+                for (std::size_t i = 0; i < frames; ++i) {
+                    RemoteReplyFrame reply;
+                    std::memcpy(&reply, in.data() + i * sizeof(reply), sizeof(reply));
+                    if (pending_.empty() || pending_.front().first != reply.id) {
+                        unexpected = true;
+                        break;
+                    }
+                    std::promise<void> promise = std::move(pending_.front().second);
+                    pending_.pop_front();
+                    if (reply.status == 0)
+                        promise.set_value();
+                    else
+                        promise.set_exception(std::make_exception_ptr(
+                                std::runtime_error("RemoteProxy: request " + std::to_string(reply.id) + " failed")));
+                }
+            }
+            if (unexpected) {
+                Fail("RemoteProxy: unexpected reply");
+                return;
+            }
+            buffered -= frames * sizeof(RemoteReplyFrame);
+            std::memmove(in.data(), in.data() + frames * sizeof(RemoteReplyFrame), buffered);
+        }
+        Fail("RemoteProxy: connection closed");
+    }
+
+public:
+    explicit RemoteProxy(const std::string& path)
+    {
+        sockaddr_un address = UnixAddress(path);
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd_ < 0)
+            throw std::system_error(errno, std::generic_category(), "RemoteProxy: socket");
+        if (::connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            int error = errno;
+            ::close(fd_);
+            throw std::system_error(error, std::generic_category(), "RemoteProxy: connect " + path);
+        }
+        reader_ = std::thread(&RemoteProxy::ReadReplies, this);
+        writer_ = std::thread(&RemoteProxy::WriteRequests, this);
+    }
+    ~RemoteProxy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            stopping_ = true;
+        }
+        send_ready_.notify_one();
+        writer_.join();
+        ::shutdown(fd_, SHUT_RDWR);
+        reader_.join();
+        ::close(fd_);
+    }
+
+    /**
+     * 发出一个请求但不等待应答。真实主体抛出异常或连接断开时，future 会抛出 std::runtime_error。
+     */
+    std::future<void> RequestAsync() const
+    {
+        std::lock_guard<std::mutex> send_lock(send_mutex_);
+        std::promise<void> promise;
+        std::future<void> future = promise.get_future();
+        RemoteRequestFrame request{next_id_++};
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            if (closed_)
+                throw std::runtime_error("RemoteProxy: connection closed");
+            pending_.emplace_back(request.id, std::move(promise));
         }
+        outgoing_.push_back(request);
+        send_ready_.notify_one();
+        return future;
+    }
+
+    void Request() const override
+    {
+        this->RequestAsync().get();
     }
 };
+
 /**
  * 客户端代码应该通过 Subject 接口与所有对象（主体和代理）一起工作，以支持真实的主体和代理。
  * 然而，在现实生活中，客户大多直接与他们的真实 subjects 工作。
@@ -79,8 +1086,267 @@ void ClientCode(const Subject& subject)
     // ...
 }
 
-int main()
+/**
+ * 读取当前进程的常驻内存（Linux 下 /proc/self/statm 的第二列，单位为页）。
+ */
+long ResidentKiB()
+{
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * 模拟一个构造代价较高、占用内存较多的真实主体。
+ */
+class HeavySubject : public RealSubject {
+    std::vector<char> payload_ = std::vector<char>(4 * 1024, 1);
+
+public:
+    void Request() const override {}
+};
+
+/**
+ * 对比 10 万个代理在饿汉式（构造即复制 RealSubject）与虚拟代理（首次请求才加载）下的启动耗时和常驻内存。
+ */
+void BenchmarkVirtualProxy(std::size_t count = 100000)
+{
+    auto measure = [count](const char* name, auto make) {
+        long before = ResidentKiB();
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::unique_ptr<Proxy>> proxies;
+        proxies.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) proxies.push_back(make());
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << count << " proxies in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms, resident +"
+                  << (ResidentKiB() - before) / 1024 << " MiB\n";
+    };
+
+    measure("virtual", [] {
+        return std::make_unique<Proxy>([] { return std::make_unique<HeavySubject>(); });
+    });
+    measure("eager  ", [] {
+        // 与 Proxy(RealSubject*) 相同的做法：构造时就创建一份真实主体。
+        auto proxy = std::make_unique<Proxy>([] { return std::make_unique<HeavySubject>(); });
+        proxy->Preload();
+        return proxy;
+    });
+
+    // 多个线程同时首次访问同一个虚拟代理，RealSubject 只应被创建一次。
+    std::atomic<int> loads{0};
+    Proxy shared([&loads] {
+        loads.fetch_add(1);
+        return std::make_unique<HeavySubject>();
+    });
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) threads.emplace_back([&shared] { shared.Preload(); });
+    for (std::thread& thread: threads) thread.join();
+    std::cout << "concurrent first access by 8 threads: RealSubject created " << loads << " time(s)\n";
+
+    // 空闲超过 ttl 后释放，下次访问时重新加载。
+    Proxy idle([] { return std::make_unique<HeavySubject>(); }, std::chrono::milliseconds(1));
+    idle.Preload();
+    bool released = idle.ReleaseIfIdle(Proxy::Clock::now() + std::chrono::milliseconds(2));
+    std::cout << "idle release: released=" << std::boolalpha << released << ", loaded=" << idle.IsLoaded() << "\n";
+}
+
+/**
+ * 模拟一个一次只能处理一个请求的慢后端。
+ */
+class SlowSubject : public RealSubject {
+    mutable std::mutex mutex_;
+
+public:
+    mutable std::atomic<int> calls{0};
+
+    void Request() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls.fetch_add(1);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+};
+
+/**
+ * 同时放行 10000 个相同请求，对比直连真实主体与经过合并代理时的后端调用次数和尾延迟。
+ */
+void BenchmarkCoalescingProxy(int burst = 10000)
+{
+    auto measure = [burst](const char* name, const Subject& subject, const SlowSubject& backend) {
+        std::promise<void> go;
+        std::shared_future<void> start = go.get_future().share();
+        std::vector<double> latencies(burst);
+        std::vector<std::thread> threads;
+        threads.reserve(burst);
+        for (int i = 0; i < burst; ++i) {
+            threads.emplace_back([&, i] {
+                start.wait();
+                auto begin = std::chrono::steady_clock::now();
+                subject.Request();
+                latencies[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            });
+        }
+        go.set_value();
+        for (std::thread& thread: threads) thread.join();
+
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << name << ": backend calls " << backend.calls << ", p50 " << latencies[burst / 2] << " ms, p99 "
+                  << latencies[burst * 99 / 100] << " ms, max " << latencies.back() << " ms\n";
+    };
+
+    SlowSubject direct;
+    measure("direct    ", direct, direct);
+    SlowSubject backend;
+    CoalescingProxy coalescing(backend);
+    measure("coalescing", coalescing, backend);
+}
+
+/**
+ * 1 到 64 个线程并发做准入检查，报告每秒检查次数和每次检查的开销；另测一次全部被拒绝时的开销。
+ */
+void BenchmarkAdmissionControl(int checks_per_thread = 200000)
+{
+    auto measure = [checks_per_thread](const char* name, AdmissionControl::Limits limits, int threads_count) {
+        AdmissionControl admission(limits);
+        std::atomic<long> admitted{0};
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads_count; ++t) {
+            threads.emplace_back([&, t] {
+                AdmissionControl::Client* client = admission.Find(t % 16 + 1);
+                long ok = 0;
+                for (int i = 0; i < checks_per_thread; ++i) {
+                    if (admission.TryAdmit(*client)) {
+                        admission.Release(*client);
+                        ++ok;
+                    }
+                }
+                admitted.fetch_add(ok);
+            });
+        }
+        for (std::thread& thread: threads) thread.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double total = double(checks_per_thread) * threads_count;
+        std::cout << name << " threads " << threads_count << ": " << total / seconds / 1e6 << " M checks/s, "
+                  << seconds * 1e9 / total << " ns/check, admitted " << admitted << "\n";
+    };
+
+    // 每个客户端 1e9/s（每纳秒一个令牌）：走完整的令牌桶路径，但速率足够高，请求全部放行。
+    AdmissionControl::Limits open{1e9, 1e6, 1024, 1 << 20};
+    AdmissionControl::Limits closed{1e-3, 1, 0, 0};
+    for (int threads = 1; threads <= 64; threads *= 2) measure("admit ", open, threads);
+    for (int threads = 1; threads <= 64; threads *= 2) measure("reject", closed, threads);
+}
+
+/**
+ * 测量请求路径写一条审计记录的开销，并确认后台线程写入的条数与产生的条数一致。
+ */
+void BenchmarkAuditLog(std::size_t records_per_thread = 1000000)
+{
+    for (int threads_count: {1, 4}) {
+        AuditLog::Options options;
+        options.path = std::filesystem::temp_directory_path() / "proxy-audit-bench";
+        options.records_per_file = 1 << 21;
+        std::uint64_t written = 0, stalls = 0;
+        double ns_per_record = 0;
+        {
+            AuditLog audit(options);
+            std::vector<std::thread> threads;
+            std::atomic<long> total_ns{0};
+            for (int t = 0; t < threads_count; ++t) {
+                threads.emplace_back([&, t] {
+                    auto start = std::chrono::steady_clock::now();
+                    for (std::size_t i = 0; i < records_per_thread; ++i) audit.Append(t + 1, AuditLog::kRequest, start, start);
+                    total_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                               std::chrono::steady_clock::now() - start)
+                                               .count());
+                });
+            }
+            for (std::thread& thread: threads) thread.join();
+            ns_per_record = double(total_ns) / double(records_per_thread * threads_count);
+            stalls = audit.Stalls();
+        }
+        // 析构后所有记录都已落盘，重新统计各个文件中的记录数。
+        for (std::size_t i = 0; i < options.max_files; ++i) {
+            std::filesystem::path path = options.path;
+            path += "." + std::to_string(i);
+            std::ifstream in(path, std::ios::binary);
+            AuditFileHeader header{};
+            if (in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+                written += header.count;
+            std::filesystem::remove(path);
+        }
+        std::cout << "audit log threads " << threads_count << ": " << ns_per_record << " ns/record, appended "
+                  << records_per_thread * threads_count << ", on disk " << written << ", producer stalls " << stalls
+                  << "\n";
+    }
+}
+
+/**
+ * 通过 Unix 域套接字调用同机的真实主体：逐个同步请求与保持 64 个未完成请求的流水线对比。
+ */
+void BenchmarkRemoteProxy(int requests = 200000)
 {
+    HeavySubject real_subject;
+    std::string path = (std::filesystem::temp_directory_path() / "proxy-remote-bench.sock").string();
+    RemoteSubjectServer server(real_subject, path);
+    RemoteProxy proxy(path);
+
+    auto report = [requests](const char* name, std::chrono::steady_clock::duration elapsed,
+                             std::vector<double>& latencies) {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << name << ": " << requests / seconds << " requests/s, p50 " << latencies[latencies.size() / 2]
+                  << " us, p99 " << latencies[latencies.size() * 99 / 100] << " us\n";
+    };
+
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        proxy.Request();
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+    }
+    report("remote sync     ", std::chrono::steady_clock::now() - start, latencies);
+
+    const int window = 64;
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::future<void>>> in_flight;
+    latencies.clear();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests || !in_flight.empty();) {
+        if (i < requests && in_flight.size() < window) {
+            in_flight.emplace_back(std::chrono::steady_clock::now(), proxy.RequestAsync());
+            ++i;
+            continue;
+        }
+        in_flight.front().second.get();
+        latencies.push_back(
+                std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - in_flight.front().first)
+                        .count());
+        in_flight.pop_front();
+    }
+    report("remote pipelined", std::chrono::steady_clock::now() - start, latencies);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        BenchmarkVirtualProxy();
+        BenchmarkCoalescingProxy();
+        BenchmarkAdmissionControl();
+        BenchmarkAuditLog();
+        BenchmarkRemoteProxy();
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "decode") {
+        AuditLog::Decode(argv[2], std::cout);
+        return 0;
+    }
+
+
     std::cout << "Client: Executing the client code with a real subject:\n";
     std::unique_ptr<RealSubject> real_subject = std::make_unique<RealSubject>();
     ClientCode(*real_subject);
@@ -90,5 +1356,41 @@ int main()
     std::unique_ptr<Proxy> proxy = std::make_unique<Proxy>(real_subject.get());
     ClientCode(*proxy);
 
+    std::cout << "\n";
+    std::cout << "Client: Executing the same client code with a virtual proxy:\n";
+    Proxy virtual_proxy;
+    std::cout << "Proxy: RealSubject loaded before request? " << std::boolalpha << virtual_proxy.IsLoaded() << "\n";
+    ClientCode(virtual_proxy);
+    std::cout << "Proxy: RealSubject loaded after request? " << virtual_proxy.IsLoaded() << "\n";
+
+    std::cout << "\n";
+    std::cout << "Client: Executing the same client code with a coalescing proxy:\n";
+    CoalescingProxy coalescing_proxy(*real_subject);
+    ClientCode(coalescing_proxy);
+
+    std::cout << "\n";
+    std::cout << "Client: Executing the same client code with a rate-limited proxy (burst of 2):\n";
+    Proxy limited_proxy;
+    limited_proxy.SetAdmissionControl(std::make_shared<AdmissionControl>(AdmissionControl::Limits{1, 2}), 42);
+    for (int i = 0; i < 3; ++i) ClientCode(limited_proxy);
+
+    std::cout << "\n";
+    std::cout << "Client: Executing the same client code with an audited proxy:\n";
+    std::filesystem::path audit_path = std::filesystem::temp_directory_path() / "proxy-audit";
+    {
+        Proxy audited_proxy;
+        audited_proxy.SetAuditLog(std::make_shared<AuditLog>(AuditLog::Options{audit_path, 1024, 1}));
+        ClientCode(audited_proxy);
+    }
+    std::cout << "Proxy: Audit log decoded (same as `Proxy decode " << audit_path.string() << ".0`):\n";
+    AuditLog::Decode(audit_path.string() + ".0", std::cout);
+
+    std::cout << "\n";
+    std::cout << "Client: Executing the same client code with a remote proxy:\n";
+    std::string socket_path = (std::filesystem::temp_directory_path() / "proxy-remote.sock").string();
+    RemoteSubjectServer server(*real_subject, socket_path);
+    RemoteProxy remote_proxy(socket_path);
+    ClientCode(remote_proxy);
+
     return 0;
 }
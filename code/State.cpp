@@ -1,7 +1,35 @@
 //
 // Created by Listening on 2022/9/20.
 //
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <tmmintrin.h>
+#endif
 
 /**
  * State 基类声明了所有具体 State 都应该实现的方法，并且还提供了对与 State 关联的 Context 对象的反向引用。
@@ -106,12 +134,1142 @@ void ConcreteStateA::Handle1()
     this->mContext->TransitionTo(new ConcreteStateB);
 }
 
-int main()
+/**
+ * 无分配模式。上面的实现每次转换都要 new 一个状态、delete 旧状态并输出日志。
+ * 这里的状态对象不保存任何上下文数据，每个具体状态只有一个预先构造好的共享实例，
+ * 上下文作为参数传给处理函数，转换只是替换一个指针。日志是可选的，只把转换记到预先分配的环形缓冲区里，需要时再输出。
+ */
+class FastContext;
+
+class SharedState {
+public:
+    virtual ~SharedState() = default;
+
+    virtual const char* Name() const = 0;
+    virtual void Handle1(FastContext& context) const = 0;
+    virtual void Handle2(FastContext& context) const = 0;
+};
+
+/**
+ * 延迟输出的转换日志。只保留最近 kCapacity 次转换，记录时不分配内存也不做 I/O。
+ */
+class TransitionLog {
+public:
+    static constexpr std::size_t kCapacity = 1024;
+
+private:
+    struct Entry {
+        const SharedState* from;
+        const SharedState* to;
+    };
+    std::array<Entry, kCapacity> mEntries;
+    std::uint64_t mCount = 0;
+
+public:
+    void Record(const SharedState* from, const SharedState* to)
+    {
+        mEntries[mCount % kCapacity] = Entry{from, to};
+        ++mCount;
+    }
+    std::uint64_t Count() const
+    {
+        return mCount;
+    }
+    /**
+     * 输出保留的转换并清空日志。
+     */
+    void Flush(std::ostream& out)
+    {
+        std::uint64_t first = mCount > kCapacity ? mCount - kCapacity : 0;
+        if (first > 0)
+            out << "(" << first << " earlier transitions dropped)\n";
+        for (std::uint64_t i = first; i < mCount; ++i) {
+            const Entry& entry = mEntries[i % kCapacity];
+            out << "FastContext: " << (entry.from ? entry.from->Name() : "(none)") << " -> " << entry.to->Name()
+                << ".\n";
+        }
+        mCount = 0;
+    }
+};
+
+class FastContext {
+private:
+    const SharedState* mState;
+    TransitionLog* mLog;
+
+public:
+    explicit FastContext(const SharedState& state, TransitionLog* log = nullptr) : mState(nullptr), mLog(log)
+    {
+        this->TransitionTo(state);
+    }
+    void TransitionTo(const SharedState& state)
+    {
+        if (this->mLog != nullptr)
+            this->mLog->Record(this->mState, &state);
+        this->mState = &state;
+    }
+    const SharedState& CurrentState() const
+    {
+        return *this->mState;
+    }
+    void Request1()
+    {
+        this->mState->Handle1(*this);
+    }
+    void Request2()
+    {
+        this->mState->Handle2(*this);
+    }
+};
+
+class SharedStateA : public SharedState {
+public:
+    const char* Name() const override
+    {
+        return "SharedStateA";
+    }
+    void Handle1(FastContext& context) const override;
+    void Handle2(FastContext&) const override {}
+};
+
+class SharedStateB : public SharedState {
+public:
+    const char* Name() const override
+    {
+        return "SharedStateB";
+    }
+    void Handle1(FastContext&) const override {}
+    void Handle2(FastContext& context) const override;
+};
+
+inline const SharedStateA kSharedStateA;
+inline const SharedStateB kSharedStateB;
+
+/**
+ * 与 ConcreteStateA/B 相同的转换规则：A 收到 request1 转到 B，B 收到 request2 转回 A。
+ */
+void SharedStateA::Handle1(FastContext& context) const
+{
+    context.TransitionTo(kSharedStateB);
+}
+
+void SharedStateB::Handle2(FastContext& context) const
+{
+    context.TransitionTo(kSharedStateA);
+}
+
+/**
+ * 表驱动的批量状态机。转换表由共享状态的处理函数“编译”而来：对每个状态、每种请求，
+ * 在临时上下文上实际执行一次处理函数，记下它转到的状态。上下文按结构数组存放，每个只占一个字节的状态编号，
+ * 对整批上下文施加同一个请求就是一次查表；状态不超过 16 个时，整张表放得进一个 SSE 寄存器，用 pshufb 每次处理 16 个上下文。
+ * 处理函数只能通过 TransitionTo() 改变状态，不能有其他副作用，否则无法表达成转换表。
+ */
+class TransitionTable {
+public:
+    enum Event : std::uint8_t { kRequest1, kRequest2, kEventCount };
+
+private:
+    std::vector<const SharedState*> mStates;
+    std::vector<std::uint8_t> mNext;
+    alignas(16) std::uint8_t mColumns[kEventCount][16] = {};
+
+public:
+    explicit TransitionTable(std::vector<const SharedState*> states) : mStates(std::move(states))
+    {
+        if (mStates.empty() || mStates.size() > 256)
+            throw std::invalid_argument("TransitionTable: between 1 and 256 states are supported");
+        mNext.resize(mStates.size() * kEventCount);
+        for (std::size_t state = 0; state < mStates.size(); ++state) {
+            for (int event = 0; event < kEventCount; ++event) {
+                FastContext probe(*mStates[state]);
+                if (event == kRequest1)
+                    probe.Request1();
+                else
+                    probe.Request2();
+                std::uint8_t next = Id(probe.CurrentState());
+                mNext[state * kEventCount + event] = next;
+                if (state < 16)
+                    mColumns[event][state] = next;
+            }
+        }
+    }
+
+    std::size_t Size() const
+    {
+        return mStates.size();
+    }
+    std::uint8_t Id(const SharedState& state) const
+    {
+        for (std::size_t id = 0; id < mStates.size(); ++id) {
+            if (mStates[id] == &state)
+                return static_cast<std::uint8_t>(id);
+        }
+        throw std::invalid_argument(std::string("TransitionTable: unknown state ") + state.Name());
+    }
+    const SharedState& State(std::uint8_t id) const
+    {
+        return *mStates.at(id);
+    }
+    std::uint8_t Next(std::uint8_t state, Event event) const
+    {
+        return mNext[std::size_t(state) * kEventCount + event];
+    }
+    const std::uint8_t* Column(Event event) const
+    {
+        return mColumns[event];
+    }
+};
+
+/**
+ * 以结构数组存放的一批上下文：每个上下文一个状态编号，外加一个 64 位的上下文数据（连接编号、会话句柄等）。
+ */
+class ContextBatch {
+private:
+    const TransitionTable& mTable;
+    std::vector<std::uint8_t> mStates;
+    std::vector<std::uint64_t> mPayloads;
+
+    void ApplyScalar(TransitionTable::Event event, std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i) mStates[i] = mTable.Next(mStates[i], event);
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("ssse3"))) std::size_t ApplyShuffle(TransitionTable::Event event, std::size_t begin,
+                                                              std::size_t end)
+    {
+        const __m128i column = _mm_load_si128(reinterpret_cast<const __m128i*>(mTable.Column(event)));
+        std::uint8_t* states = mStates.data();
+        for (; begin + 16 <= end; begin += 16) {
+            __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(states + begin));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(states + begin), _mm_shuffle_epi8(column, current));
+        }
+        return begin;
+    }
+
+    static bool HasShuffle()
+    {
+        static const bool supported = __builtin_cpu_supports("ssse3");
+        return supported;
+    }
+#endif
+
+public:
+    ContextBatch(const TransitionTable& table, std::size_t count, const SharedState& initial)
+        : mTable(table), mStates(count, table.Id(initial)), mPayloads(count)
+    {
+    }
+
+    std::size_t Size() const
+    {
+        return mStates.size();
+    }
+    const SharedState& StateOf(std::size_t context) const
+    {
+        return mTable.State(mStates[context]);
+    }
+    void TransitionTo(std::size_t context, const SharedState& state)
+    {
+        mStates[context] = mTable.Id(state);
+    }
+    const TransitionTable& Table() const
+    {
+        return mTable;
+    }
+    std::uint8_t* StateIds()
+    {
+        return mStates.data();
+    }
+    const std::uint8_t* StateIds() const
+    {
+        return mStates.data();
+    }
+    std::uint64_t* Payloads()
+    {
+        return mPayloads.data();
+    }
+    const std::uint64_t* Payloads() const
+    {
+        return mPayloads.data();
+    }
+
+    /**
+     * 对 [begin, end) 中的每个上下文施加同一个请求。
+     */
+    void Apply(TransitionTable::Event event, std::size_t begin, std::size_t end)
+    {
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (mTable.Size() <= 16 && HasShuffle())
+            begin = ApplyShuffle(event, begin, end);
+#endif
+        ApplyScalar(event, begin, end);
+    }
+    void Apply(TransitionTable::Event event)
+    {
+        Apply(event, 0, mStates.size());
+    }
+    /**
+     * 对第 i 个上下文施加 events[i]。先检查所有事件编号都小于 kEventCount，
+     * 有越界的编号时抛出 std::out_of_range，不修改任何上下文。
+     */
+    void Apply(const std::uint8_t* events)
+    {
+        std::uint8_t largest = 0;
+        for (std::size_t i = 0; i < mStates.size(); ++i) largest = std::max(largest, events[i]);
+        if (!mStates.empty() && largest >= TransitionTable::kEventCount)
+            throw std::out_of_range("ContextBatch: event id out of range");
+        for (std::size_t i = 0; i < mStates.size(); ++i)
+            mStates[i] = mTable.Next(mStates[i], static_cast<TransitionTable::Event>(events[i]));
+    }
+};
+
+/**
+ * 有界的多生产者单消费者无锁队列（Vyukov 的序号环形队列），容量为 2 的幂。
+ * 同一个生产者推入的元素按推入顺序被取出。
+ */
+template <typename T>
+class MpscQueue {
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+    std::unique_ptr<Cell[]> mCells;
+    std::size_t mMask;
+    alignas(64) std::atomic<std::size_t> mTail{0};
+    alignas(64) std::size_t mHead = 0;
+
+public:
+    explicit MpscQueue(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mCells.reset(new Cell[size]);
+        mMask = size - 1;
+        for (std::size_t i = 0; i < size; ++i) mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool TryPush(const T& value)
+    {
+        std::size_t position = mTail.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &mCells[position & mMask];
+            std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+            if (difference == 0) {
+                if (mTail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+                return false;
+            else
+                position = mTail.load(std::memory_order_relaxed);
+        }
+        cell->value = value;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * 只能由唯一的消费者线程调用。
+     */
+    bool TryPop(T& value)
+    {
+        Cell& cell = mCells[mHead & mMask];
+        if (cell.sequence.load(std::memory_order_acquire) != mHead + 1)
+            return false;
+        value = cell.value;
+        cell.sequence.store(mHead + mMask + 1, std::memory_order_release);
+        ++mHead;
+        return true;
+    }
+};
+
+/**
+ * 分片的 actor 式运行时。上下文按编号分配到各个分片，每个分片由一个工作线程独占，
+ * 外部线程通过分片的 MPSC 队列投递事件。同一个上下文的事件总在同一个线程上按投递顺序处理，
+ * 不同分片的上下文并行推进，上下文本身不需要加锁。每个事件从投递到处理完成的延迟记入按 2 的幂分桶的直方图。
+ * 空闲的工作线程、等待队列空位的投递者和 Drain() 都只短暂让出几次处理器，之后阻塞在分片的条件变量上，
+ * 没有事件时不占用 CPU。
+ */
+class ShardedRuntime {
+private:
+    struct Message {
+        std::uint64_t context;
+        std::uint64_t posted_ns;
+        TransitionTable::Event event;
+    };
+    struct alignas(64) Shard {
+        MpscQueue<Message> queue;
+        std::vector<FastContext> contexts;
+        std::array<std::uint64_t, 64> latency{};
+        std::atomic<std::uint64_t> posted{0};
+        std::atomic<std::uint64_t> processed{0};
+        // 阻塞等待：waiters 为 0 时另一端不必加锁通知。
+        std::atomic<int> waiters{0};
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::thread worker;
+
+        explicit Shard(std::size_t capacity) : queue(capacity) {}
+    };
+
+    static constexpr int kSpins = 64;
+
+    std::vector<std::unique_ptr<Shard>> mShards;
+    std::uint64_t mContexts;
+    std::atomic<bool> mStop{false};
+
+    static std::uint64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    /**
+     * 修改队列或计数之后调用。与 Wait() 中的 seq_cst 栅栏配对：要么这里看到等待者并加锁通知，
+     * 要么等待者登记后重新检查时看到了刚才的修改，不会丢失唤醒。
+     */
+    static void Wake(Shard& shard)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (shard.waiters.load(std::memory_order_relaxed) == 0)
+            return;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.changed.notify_all();
+    }
+    /**
+     * 等到 ready() 为真：先让出处理器重试几次，仍不满足再登记为等待者并阻塞。
+     */
+    template <typename Ready>
+    static void Wait(Shard& shard, Ready&& ready)
+    {
+        for (int spin = 0; spin < kSpins; ++spin) {
+            if (ready())
+                return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        shard.waiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        shard.changed.wait(lock, ready);
+        shard.waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void Work(Shard& shard)
+    {
+        Message message;
+        for (;;) {
+            if (!shard.queue.TryPop(message)) {
+                bool popped = false;
+                Wait(shard, [&] {
+                    popped = shard.queue.TryPop(message);
+                    return popped || mStop.load(std::memory_order_acquire);
+                });
+                if (!popped)
+                    return;
+            }
+            FastContext& context = shard.contexts[message.context / mShards.size()];
+            if (message.event == TransitionTable::kRequest1)
+                context.Request1();
+            else
+                context.Request2();
+            std::uint64_t latency = NowNs() - message.posted_ns;
+            // 不小于 2^63 的延迟计入最后一个分桶。
+            ++shard.latency[latency == 0 ? 0 : std::min(64 - __builtin_clzll(latency), 63)];
+            shard.processed.fetch_add(1, std::memory_order_release);
+            Wake(shard);
+        }
+    }
+
+public:
+    ShardedRuntime(std::size_t contexts, std::size_t shards, const SharedState& initial,
+                   std::size_t queue_capacity = 1 << 14)
+        : mContexts(contexts)
+    {
+        if (shards == 0)
+            throw std::invalid_argument("ShardedRuntime: at least one shard is required");
+        for (std::size_t i = 0; i < shards; ++i) {
+            mShards.push_back(std::make_unique<Shard>(queue_capacity));
+            mShards.back()->contexts.assign((contexts + shards - 1 - i) / shards, FastContext(initial));
+        }
+        for (auto& shard: mShards) {
+            Shard* owned = shard.get();
+            owned->worker = std::thread([this, owned] { Work(*owned); });
+        }
+    }
+    ~ShardedRuntime()
+    {
+        mStop.store(true, std::memory_order_release);
+        for (auto& shard: mShards) {
+            {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                shard->changed.notify_all();
+            }
+            shard->worker.join();
+        }
+    }
+    ShardedRuntime(const ShardedRuntime&) = delete;
+    ShardedRuntime& operator=(const ShardedRuntime&) = delete;
+
+    /**
+     * 可以从任意线程调用。队列满时阻塞等待分片消化；上下文编号越界时抛出 std::out_of_range。
+     */
+    void Post(std::uint64_t context, TransitionTable::Event event)
+    {
+        if (context >= mContexts)
+            throw std::out_of_range("ShardedRuntime: context id out of range");
+        Shard& shard = *mShards[context % mShards.size()];
+        shard.posted.fetch_add(1, std::memory_order_relaxed);
+        Message message{context, NowNs(), event};
+        if (!shard.queue.TryPush(message))
+            Wait(shard, [&] { return shard.queue.TryPush(message); });
+        Wake(shard);
+    }
+
+    /**
+     * 等待此前投递的所有事件处理完。之后可以安全地读取状态和延迟统计。
+     */
+    void Drain()
+    {
+        for (auto& shard: mShards) {
+            Wait(*shard, [&shard] {
+                return shard->processed.load(std::memory_order_acquire) ==
+                       shard->posted.load(std::memory_order_relaxed);
+            });
+        }
+    }
+
+    const SharedState& StateOf(std::uint64_t context) const
+    {
+        return mShards[context % mShards.size()]->contexts[context / mShards.size()].CurrentState();
+    }
+
+    /**
+     * 延迟的近似分位数（所在分桶的上界，纳秒），只在 Drain() 之后调用。
+     */
+    std::uint64_t LatencyPercentile(double percentile) const
+    {
+        std::array<std::uint64_t, 64> merged{};
+        std::uint64_t total = 0;
+        for (const auto& shard: mShards) {
+            for (std::size_t bucket = 0; bucket < merged.size(); ++bucket) merged[bucket] += shard->latency[bucket];
+            total += shard->processed.load(std::memory_order_acquire);
+        }
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < merged.size(); ++bucket) {
+            seen += merged[bucket];
+            if (seen >= total * percentile)
+                return bucket == 0 ? 0 : (std::uint64_t(1) << bucket) - 1;
+        }
+        return UINT64_MAX;
+    }
+};
+
+/**
+ * 状态机群体的二进制快照。文件以定长头开始，随后是状态名表，保证状态编号在重新编译后变化时仍能正确映射：
+ *   全量快照：uint8 状态编号[count]，按 8 字节补齐，然后是 uint64 上下文数据[count]，可以整块 mmap 后直接复制；
+ *   增量快照：只包含与基准快照不同的上下文，每项为 DeltaEntry，头中记录基准快照的编号。
+ * 写快照时 fork 出子进程，子进程看到的是 fork 那一刻的写时复制内存，父进程可以继续处理事件。
+ * 调用 Write*() 时不能有其他线程正在修改这批上下文，fork 之后则不受限制。
+ */
+class Snapshot {
+public:
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::size_t kNameSize = 32;
+    enum Kind : std::uint32_t { kFull, kDelta };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        Kind kind;
+        std::uint64_t id;
+        std::uint64_t base_id;
+        std::uint64_t count;
+        std::uint64_t entries;
+        std::uint32_t state_count;
+        std::uint32_t reserved;
+    };
+    struct DeltaEntry {
+        std::uint64_t index;
+        std::uint64_t payload;
+        std::uint8_t state;
+        std::uint8_t reserved[7];
+    };
+
+    /**
+     * 正在后台写入的快照。Wait() 等待子进程结束，写入失败时删除临时文件并抛出异常。
+     */
+    class Pending {
+    private:
+        pid_t mPid;
+        std::string mTemporary;
+
+        bool Reap()
+        {
+            int status = 0;
+            pid_t pid = mPid;
+            mPid = -1;
+            if (::waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                ::unlink(mTemporary.c_str());
+                return false;
+            }
+            return true;
+        }
+
+    public:
+        Pending(pid_t pid, std::string temporary) : mPid(pid), mTemporary(std::move(temporary)) {}
+        Pending(Pending&& other) noexcept : mPid(other.mPid), mTemporary(std::move(other.mTemporary))
+        {
+            other.mPid = -1;
+        }
+        Pending& operator=(Pending&&) = delete;
+        ~Pending()
+        {
+            if (mPid > 0)
+                Reap();
+        }
+        void Wait()
+        {
+            if (mPid <= 0)
+                throw std::logic_error("Snapshot: Wait() called on a snapshot that was already waited for");
+            if (!Reap())
+                throw std::runtime_error("Snapshot: writer process failed");
+        }
+    };
+
+private:
+    static constexpr char kMagic[8] = {'F', 'S', 'M', 'S', 'N', 'A', 'P', '\0'};
+
+    /**
+     * 只读映射一个快照文件并校验文件头。
+     */
+    class Mapping {
+    private:
+        void* mData = MAP_FAILED;
+        std::size_t mSize = 0;
+
+    public:
+        explicit Mapping(const std::string& path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "Snapshot: open " + path);
+            struct stat info {};
+            if (::fstat(fd, &info) == 0)
+                mSize = static_cast<std::size_t>(info.st_size);
+            if (mSize >= sizeof(Header))
+                mData = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            int error = errno;
+            ::close(fd);
+            if (mSize < sizeof(Header))
+                throw std::runtime_error("Snapshot: truncated file " + path);
+            if (mData == MAP_FAILED)
+                throw std::system_error(error, std::generic_category(), "Snapshot: mmap " + path);
+            if (const char* problem = this->Problem()) {
+                ::munmap(mData, mSize);
+                throw std::runtime_error(std::string("Snapshot: ") + problem + " " + path);
+            }
+        }
+        ~Mapping()
+        {
+            if (mData != MAP_FAILED)
+                ::munmap(mData, mSize);
+        }
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+
+        const Header& FileHeader() const
+        {
+            return *static_cast<const Header*>(mData);
+        }
+        const char* Names() const
+        {
+            return static_cast<const char*>(mData) + sizeof(Header);
+        }
+        std::size_t Body() const
+        {
+            return sizeof(Header) + std::size_t(FileHeader().state_count) * kNameSize;
+        }
+        /**
+         * 校验文件头，并确认文件装得下头中声明的全部数据，返回问题描述，没有问题时返回 nullptr。
+         * 头中的计数可能被损坏成任意值，所以用除法和剩余字节数比较，不先做可能溢出的乘法。
+         */
+        const char* Problem() const
+        {
+            const Header& header = FileHeader();
+            if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+                (header.kind != kFull && header.kind != kDelta))
+                return "unsupported file";
+            std::size_t available = mSize - sizeof(Header);
+            if (header.state_count > available / kNameSize)
+                return "truncated file";
+            available -= std::size_t(header.state_count) * kNameSize;
+            if (header.kind == kDelta)
+                return header.entries > available / sizeof(DeltaEntry) ? "truncated file" : nullptr;
+            // 状态列每项 1 字节、补齐最多 7 字节，数据列每项 8 字节。
+            if (header.count > available / (1 + sizeof(std::uint64_t)) ||
+                Padded(header.count) + header.count * sizeof(std::uint64_t) > available)
+                return "truncated file";
+            return nullptr;
+        }
+        const char* At(std::size_t offset) const
+        {
+            return static_cast<const char*>(mData) + Body() + offset;
+        }
+    };
+
+    static std::size_t Padded(std::uint64_t count)
+    {
+        return (count + 7) & ~std::uint64_t(7);
+    }
+
+    /**
+     * 快照中的状态编号到当前状态表编号的映射。
+     */
+    static std::array<std::uint8_t, 256> Translation(const Mapping& mapping, const TransitionTable& table,
+                                                     bool& identity)
+    {
+        std::array<std::uint8_t, 256> translation{};
+        identity = true;
+        if (mapping.FileHeader().state_count > translation.size())
+            throw std::runtime_error("Snapshot: too many states in snapshot");
+        for (std::uint32_t id = 0; id < mapping.FileHeader().state_count; ++id) {
+            std::string name(mapping.Names() + id * kNameSize, strnlen(mapping.Names() + id * kNameSize, kNameSize));
+            std::size_t current = 0;
+            while (current < table.Size() && name != table.State(current).Name()) ++current;
+            if (current == table.Size())
+                throw std::runtime_error("Snapshot: unknown state " + name);
+            translation[id] = static_cast<std::uint8_t>(current);
+            identity &= current == id;
+        }
+        return translation;
+    }
+
+    /**
+     * 所有状态编号都小于 state_count。用最大值归约，编译器可以向量化。
+     */
+    static bool ValidStates(const std::uint8_t* states, std::size_t count, std::uint32_t state_count)
+    {
+        std::uint8_t largest = 0;
+        for (std::size_t i = 0; i < count; ++i) largest = std::max(largest, states[i]);
+        return count == 0 || largest < state_count;
+    }
+
+    /**
+     * 在子进程中调用，只使用 write(2)，不抛异常。
+     */
+    static bool WriteAll(int fd, const void* data, std::size_t size) noexcept
+    {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t written = ::write(fd, p, size);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+            p += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+
+    /**
+     * 文件头和状态名表，在 fork 之前准备好。状态名必须短于 kNameSize，保证以 '\0' 结尾。
+     */
+    static std::vector<char> Prologue(Header header, const TransitionTable& table)
+    {
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.state_count = static_cast<std::uint32_t>(table.Size());
+        std::vector<char> prologue(sizeof(header) + table.Size() * kNameSize, '\0');
+        std::memcpy(prologue.data(), &header, sizeof(header));
+        for (std::size_t id = 0; id < table.Size(); ++id) {
+            const char* name = table.State(id).Name();
+            std::size_t length = std::strlen(name);
+            if (length >= kNameSize)
+                throw std::length_error("Snapshot: state name too long: " + std::string(name));
+            std::memcpy(prologue.data() + sizeof(header) + id * kNameSize, name, length);
+        }
+        return prologue;
+    }
+
+    /**
+     * 在子进程中执行 write，先写临时文件，成功后原子地改名，失败时子进程以非零状态退出。
+     * 临时文件名由 mkostemp 生成，同时写往同一路径的多个快照不会互相覆盖临时文件。
+     * 父进程可能还有其他线程，fork 时它们持有的锁（包括 malloc 的锁）在子进程中永远不会释放，
+     * 所以临时文件在 fork 之前打开，路径和缓冲区都事先准备好，子进程里只调用异步信号安全的函数。
+     */
+    template <typename Write>
+    static Pending Fork(const std::string& path, Write write)
+    {
+        std::string temporary = path + ".XXXXXX";
+        int fd = ::mkostemp(temporary.data(), O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "Snapshot: mkostemp " + temporary);
+        if (::fchmod(fd, 0644) != 0) {
+            int error = errno;
+            ::close(fd);
+            ::unlink(temporary.c_str());
+            throw std::system_error(error, std::generic_category(), "Snapshot: fchmod " + temporary);
+        }
+        pid_t pid = ::fork();
+        if (pid < 0) {
+            int error = errno;
+            ::close(fd);
+            ::unlink(temporary.c_str());
+            throw std::system_error(error, std::generic_category(), "Snapshot: fork");
+        }
+        if (pid == 0) {
+            bool written = write(fd) && ::fsync(fd) == 0;
+            bool closed = ::close(fd) == 0;
+            ::_exit(written && closed && ::rename(temporary.c_str(), path.c_str()) == 0 ? 0 : 1);
+        }
+        ::close(fd);
+        return Pending(pid, std::move(temporary));
+    }
+
+public:
+    /**
+     * 在后台写全量快照。
+     */
+    static Pending WriteFull(const ContextBatch& batch, const std::string& path, std::uint64_t id)
+    {
+        Header header{};
+        header.kind = kFull;
+        header.id = id;
+        header.count = batch.Size();
+        std::vector<char> prologue = Prologue(header, batch.Table());
+        return Fork(path, [&batch, &prologue](int fd) noexcept {
+            static const char padding[8] = {};
+            return WriteAll(fd, prologue.data(), prologue.size()) && WriteAll(fd, batch.StateIds(), batch.Size()) &&
+                   WriteAll(fd, padding, Padded(batch.Size()) - batch.Size()) &&
+                   WriteAll(fd, batch.Payloads(), batch.Size() * sizeof(std::uint64_t));
+        });
+    }
+
+    /**
+     * 在后台写增量快照：只记录与基准全量快照 base_path 不同的上下文。
+     * 基准快照的映射、状态编号映射和输出缓冲区都在 fork 之前准备好。
+     */
+    static Pending WriteDelta(const ContextBatch& batch, const std::string& base_path, const std::string& path,
+                              std::uint64_t id)
+    {
+        Mapping base(base_path);
+        if (base.FileHeader().kind != kFull || base.FileHeader().count != batch.Size())
+            throw std::runtime_error("Snapshot: delta base must be a full snapshot of the same population");
+        bool identity = true;
+        std::array<std::uint8_t, 256> translation = Translation(base, batch.Table(), identity);
+        std::uint32_t base_state_count = base.FileHeader().state_count;
+        const auto* base_states = reinterpret_cast<const std::uint8_t*>(base.At(0));
+        const auto* base_payloads = reinterpret_cast<const std::uint64_t*>(base.At(Padded(batch.Size())));
+
+        Header header{};
+        header.kind = kDelta;
+        header.id = id;
+        header.base_id = base.FileHeader().id;
+        header.count = batch.Size();
+        std::vector<char> prologue = Prologue(header, batch.Table());
+        std::vector<DeltaEntry> buffer(4096);
+        return Fork(path, [&](int fd) noexcept {
+            if (!ValidStates(base_states, batch.Size(), base_state_count) ||
+                !WriteAll(fd, prologue.data(), prologue.size()))
+                return false;
+            std::size_t used = 0;
+            std::uint64_t entries = 0;
+            for (std::size_t i = 0; i < batch.Size(); ++i) {
+                if (translation[base_states[i]] == batch.StateIds()[i] && base_payloads[i] == batch.Payloads()[i])
+                    continue;
+                buffer[used++] = DeltaEntry{i, batch.Payloads()[i], batch.StateIds()[i], {}};
+                ++entries;
+                if (used == buffer.size()) {
+                    if (!WriteAll(fd, buffer.data(), used * sizeof(DeltaEntry)))
+                        return false;
+                    used = 0;
+                }
+            }
+            if (!WriteAll(fd, buffer.data(), used * sizeof(DeltaEntry)))
+                return false;
+            // 条目数写完才知道，回填到文件头里。
+            auto* written = reinterpret_cast<Header*>(prologue.data());
+            written->entries = entries;
+            return ::pwrite(fd, written, sizeof(Header), 0) == static_cast<ssize_t>(sizeof(Header));
+        });
+    }
+
+    /**
+     * 用 mmap 整块恢复全量快照，返回快照编号。批的大小必须与快照一致。
+     */
+    static std::uint64_t Restore(ContextBatch& batch, const std::string& path)
+    {
+        Mapping mapping(path);
+        const Header& header = mapping.FileHeader();
+        if (header.kind != kFull || header.count != batch.Size())
+            throw std::runtime_error("Snapshot: " + path + " is not a full snapshot of this population");
+        bool identity = true;
+        std::array<std::uint8_t, 256> translation = Translation(mapping, batch.Table(), identity);
+        const auto* states = reinterpret_cast<const std::uint8_t*>(mapping.At(0));
+        if (!ValidStates(states, batch.Size(), header.state_count))
+            throw std::runtime_error("Snapshot: corrupt state id in " + path);
+        if (identity) {
+            std::memcpy(batch.StateIds(), states, batch.Size());
+        }
+        else {
+            for (std::size_t i = 0; i < batch.Size(); ++i) batch.StateIds()[i] = translation[states[i]];
+        }
+        std::memcpy(batch.Payloads(), mapping.At(Padded(batch.Size())), batch.Size() * sizeof(std::uint64_t));
+        return header.id;
+    }
+
+    /**
+     * 在已恢复的基准快照 base_id 之上应用增量快照，返回增量快照编号。
+     */
+    static std::uint64_t ApplyDelta(ContextBatch& batch, const std::string& path, std::uint64_t base_id)
+    {
+        Mapping mapping(path);
+        const Header& header = mapping.FileHeader();
+        if (header.kind != kDelta || header.count != batch.Size() || header.base_id != base_id)
+            throw std::runtime_error("Snapshot: " + path + " is not a delta over snapshot " + std::to_string(base_id));
+        bool identity = true;
+        std::array<std::uint8_t, 256> translation = Translation(mapping, batch.Table(), identity);
+        const auto* entries = reinterpret_cast<const DeltaEntry*>(mapping.At(0));
+        for (std::uint64_t i = 0; i < header.entries; ++i) {
+            if (entries[i].index >= batch.Size() || entries[i].state >= header.state_count)
+                throw std::runtime_error("Snapshot: corrupt delta entry in " + path);
+            batch.StateIds()[entries[i].index] = translation[entries[i].state];
+            batch.Payloads()[entries[i].index] = entries[i].payload;
+        }
+        return header.id;
+    }
+};
+
+/**
+ * 丢弃所有输出的流缓冲区。与把 rdbuf 设为空不同，格式化的开销仍然保留。
+ */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+};
+
+/**
+ * 每轮 Request1 + Request2 触发两次转换，比较原实现（输出被丢弃）与无分配模式的转换速率。
+ */
+void BenchmarkTransitions()
+{
+    auto report = [](const char* name, int transitions, std::chrono::duration<double> elapsed) {
+        std::cout << name << transitions / elapsed.count() / 1e6 << " M transitions/s\n";
+    };
+
+    constexpr int kOriginalRounds = 200000;
+    NullBuffer null_buffer;
+    std::streambuf* console = std::cout.rdbuf(&null_buffer);
+    auto start = std::chrono::steady_clock::now();
+    {
+        Context context(new ConcreteStateA);
+        for (int i = 0; i < kOriginalRounds; ++i) {
+            context.Request1();
+            context.Request2();
+        }
+    }
+    std::chrono::duration<double> original = std::chrono::steady_clock::now() - start;
+    std::cout.rdbuf(console);
+    report("new/delete + cout      ", 2 * kOriginalRounds, original);
+
+    constexpr int kFastRounds = 20000000;
+    FastContext fast(kSharedStateA);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kFastRounds; ++i) {
+        fast.Request1();
+        fast.Request2();
+    }
+    report("shared states          ", 2 * kFastRounds, std::chrono::steady_clock::now() - start);
+
+    TransitionLog log;
+    FastContext logged(kSharedStateA, &log);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kFastRounds; ++i) {
+        logged.Request1();
+        logged.Request2();
+    }
+    report("shared states + log    ", 2 * kFastRounds, std::chrono::steady_clock::now() - start);
+    std::cout << "final states " << fast.CurrentState().Name() << " / " << logged.CurrentState().Name() << ", logged "
+              << log.Count() << " transitions\n";
+}
+
+/**
+ * 1000 万个上下文，依次施加一串请求，比较每个上下文一个状态指针加虚函数分派与表驱动批处理的吞吐量。
+ */
+void BenchmarkBatchTable()
+{
+    constexpr std::size_t kContexts = 10000000;
+    TransitionTable table({&kSharedStateA, &kSharedStateB});
+    auto initial = [](std::size_t i) -> const SharedState& {
+        return (i * 2654435761u >> 7) & 1 ? static_cast<const SharedState&>(kSharedStateB) : kSharedStateA;
+    };
+    auto report = [](const char* name, double events, std::chrono::duration<double> elapsed) {
+        std::cout << name << events / elapsed.count() / 1e6 << " M events/s\n";
+    };
+
+    constexpr int kPointerRounds = 4;
+    std::vector<FastContext> contexts;
+    contexts.reserve(kContexts);
+    for (std::size_t i = 0; i < kContexts; ++i) contexts.emplace_back(initial(i));
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kPointerRounds; ++round) {
+        for (FastContext& context: contexts) {
+            if (round % 2 == 0)
+                context.Request1();
+            else
+                context.Request2();
+        }
+    }
+    report("state pointer per context  ", double(kContexts) * kPointerRounds, std::chrono::steady_clock::now() - start);
+
+    constexpr int kTableRounds = 40;
+    ContextBatch batch(table, kContexts, kSharedStateA);
+    for (std::size_t i = 0; i < kContexts; ++i) batch.TransitionTo(i, initial(i));
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kTableRounds; ++round)
+        batch.Apply(round % 2 == 0 ? TransitionTable::kRequest1 : TransitionTable::kRequest2);
+    report("table-driven batch         ", double(kContexts) * kTableRounds, std::chrono::steady_clock::now() - start);
+
+    // 偶数轮之后两种实现应处于相同状态
+    bool identical = true;
+    for (std::size_t i = 0; i < kContexts; ++i) identical &= &batch.StateOf(i) == &contexts[i].CurrentState();
+    std::cout << "identical states " << std::boolalpha << identical << "\n";
+}
+
+/**
+ * 固定两个投递线程，分片数从 1 增加到硬件线程数（至少到 4），测量吞吐量和事件延迟。
+ */
+void BenchmarkShardedRuntime()
+{
+    constexpr std::size_t kContexts = 1000000;
+    constexpr std::size_t kEventsPerProducer = 2000000;
+    constexpr int kProducers = 2;
+    std::size_t max_shards = std::max(4u, std::thread::hardware_concurrency());
+    std::cout << "hardware threads " << std::thread::hardware_concurrency() << ", " << kProducers << " producers\n";
+    for (std::size_t shards = 1; shards <= max_shards; shards *= 2) {
+        ShardedRuntime runtime(kContexts, shards, kSharedStateA);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> producers;
+        for (int p = 0; p < kProducers; ++p) {
+            producers.emplace_back([&runtime, p] {
+                std::uint64_t context = p * 7919;
+                for (std::size_t i = 0; i < kEventsPerProducer; ++i) {
+                    context = (context + 104729) % kContexts;
+                    runtime.Post(context, i % 2 == 0 ? TransitionTable::kRequest1 : TransitionTable::kRequest2);
+                }
+            });
+        }
+        for (std::thread& producer: producers) producer.join();
+        runtime.Drain();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << std::setw(3) << shards << " shards: " << std::setw(7) << std::fixed << std::setprecision(2)
+                  << kProducers * kEventsPerProducer / elapsed.count() / 1e6 << " M events/s, latency p50 <= "
+                  << runtime.LatencyPercentile(0.5) / 1000.0 << " us, p99 <= "
+                  << runtime.LatencyPercentile(0.99) / 1000.0 << " us\n"
+                  << std::defaultfloat << std::setprecision(6);
+    }
+}
+
+/**
+ * 1000 万个上下文的全量快照、增量快照与恢复耗时。快照在后台写入时父进程继续处理事件，
+ * 恢复出的内容必须等于 fork 那一刻的状态。
+ */
+void BenchmarkSnapshot()
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr std::size_t kContexts = 10000000;
+    const std::string full_path = (std::filesystem::temp_directory_path() / "state_snapshot.full").string();
+    const std::string delta_path = (std::filesystem::temp_directory_path() / "state_snapshot.delta").string();
+    auto ms = [](Clock::duration elapsed) { return std::chrono::duration<double, std::milli>(elapsed).count(); };
+
+    TransitionTable table({&kSharedStateA, &kSharedStateB});
+    ContextBatch batch(table, kContexts, kSharedStateA);
+    for (std::size_t i = 0; i < kContexts; ++i) {
+        batch.StateIds()[i] = (i * 2654435761u >> 7) & 1;
+        batch.Payloads()[i] = i * 0x9E3779B97F4A7C15ULL;
+    }
+    std::vector<std::uint8_t> expected_states(batch.StateIds(), batch.StateIds() + kContexts);
+
+    auto start = Clock::now();
+    Snapshot::Pending full = Snapshot::WriteFull(batch, full_path, 1);
+    auto forked = Clock::now();
+    int rounds = 0;
+    for (; rounds < 4; ++rounds) batch.Apply(rounds % 2 == 0 ? TransitionTable::kRequest1 : TransitionTable::kRequest2);
+    full.Wait();
+    std::cout << "full snapshot  " << ms(Clock::now() - start) << " ms (fork " << ms(forked - start) << " ms, "
+              << rounds << " event rounds processed meanwhile)\n";
+
+    // 1% 的上下文在两次快照之间发生变化
+    for (std::size_t i = 0; i < kContexts; i += 100) {
+        batch.StateIds()[i] ^= 1;
+        batch.Payloads()[i] += 1;
+    }
+    std::vector<std::uint8_t> expected_delta(batch.StateIds(), batch.StateIds() + kContexts);
+    start = Clock::now();
+    Snapshot::WriteDelta(batch, full_path, delta_path, 2).Wait();
+    std::cout << "delta snapshot " << ms(Clock::now() - start) << " ms\n";
+
+    ContextBatch restored(table, kContexts, kSharedStateA);
+    start = Clock::now();
+    std::uint64_t base_id = Snapshot::Restore(restored, full_path);
+    std::cout << "full restore   " << ms(Clock::now() - start) << " ms, matches fork-time state " << std::boolalpha
+              << (std::memcmp(restored.StateIds(), expected_states.data(), kContexts) == 0) << "\n";
+    start = Clock::now();
+    Snapshot::ApplyDelta(restored, delta_path, base_id);
+    std::cout << "delta restore  " << ms(Clock::now() - start) << " ms, matches "
+              << (std::memcmp(restored.StateIds(), expected_delta.data(), kContexts) == 0 &&
+                  std::memcmp(restored.Payloads(), batch.Payloads(), kContexts * sizeof(std::uint64_t)) == 0)
+              << "\n";
+    std::remove(full_path.c_str());
+    std::remove(delta_path.c_str());
+}
+
+int main(int argc, char* argv[])
 {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        BenchmarkTransitions();
+        BenchmarkBatchTable();
+        BenchmarkShardedRuntime();
+        BenchmarkSnapshot();
+        return 0;
+    }
+
     Context* context = new Context(new ConcreteStateA);
     context->Request1();
     context->Request2();
     delete context;
 
+    std::cout << "\nShared states transition without allocating:\n";
+    TransitionLog log;
+    FastContext fast(kSharedStateA, &log);
+    fast.Request1();
+    fast.Request2();
+    log.Flush(std::cout);
+
+    std::cout << "\nThe same rules compiled into a transition table:\n";
+    TransitionTable table({&kSharedStateA, &kSharedStateB});
+    for (std::uint8_t id = 0; id < table.Size(); ++id) {
+        std::cout << table.State(id).Name() << ": request1 -> "
+                  << table.State(table.Next(id, TransitionTable::kRequest1)).Name() << ", request2 -> "
+                  << table.State(table.Next(id, TransitionTable::kRequest2)).Name() << "\n";
+    }
+
+    std::cout << "\nEvents for different contexts can be processed by sharded workers:\n";
+    ShardedRuntime runtime(4, 2, kSharedStateA);
+    runtime.Post(0, TransitionTable::kRequest1);
+    runtime.Post(1, TransitionTable::kRequest1);
+    runtime.Post(1, TransitionTable::kRequest2);
+    runtime.Drain();
+    for (std::uint64_t id = 0; id < 4; ++id)
+        std::cout << "context " << id << ": " << runtime.StateOf(id).Name() << "\n";
+
     return 0;
 }
\ No newline at end of file
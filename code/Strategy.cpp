@@ -2,10 +2,31 @@
 // Created by Listening on 2023/4/7.
 // 策略模式
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 /**
  * Strategy接口声明某些算法的所有受支持版本通用的操作。
  *
@@ -15,6 +36,24 @@ class Strategy {
 public:
     virtual ~Strategy() = default;
     virtual std::string doAlgorithm(std::string_view data) const = 0;
+    /**
+     * 流式版本：从 in 读取数据，把结果写入 out。默认实现把数据整体读入内存再调用 doAlgorithm()，
+     * 能在固定内存内处理任意大输入的策略会覆盖它。
+     */
+    virtual void doStreamAlgorithm(std::istream& in, std::ostream& out) const
+    {
+        std::string data(std::istreambuf_iterator<char>(in), {});
+        std::string result = doAlgorithm(data);
+        out.write(result.data(), static_cast<std::streamsize>(result.size()));
+    }
+    /**
+     * 把结果写进调用方提供的 out，复用其容量，热循环中可避免每次调用都分配内存。
+     * 默认实现退回到返回新字符串的版本；覆盖它的子类要同时覆盖两个重载，以免隐藏其中一个。
+     */
+    virtual void doAlgorithm(std::string_view data, std::string& out) const
+    {
+        out = doAlgorithm(data);
+    }
 };
 
 /**
@@ -52,12 +91,43 @@ public:
             std::cout << "Context: Strategy isn't set\n";
         }
     }
+    /**
+     * 对文件做同样的业务逻辑，数据量可以大于内存，是否能在固定内存内完成取决于策略。
+     * 结果先写到 output 旁边的临时文件，成功后再改名覆盖 output，所以 input 与 output 可以是同一个文件，
+     * 失败时 output 保持原样。未设置策略时不会碰 output。
+     */
+    void doSomeBusinessLogic(const std::filesystem::path& input, const std::filesystem::path& output) const
+    {
+        if (!strategy_) {
+            std::cout << "Context: Strategy isn't set\n";
+            return;
+        }
+        std::filesystem::path temporary = output;
+        temporary += ".tmp";
+        try {
+            {
+                std::ifstream in(input, std::ios::binary);
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                if (!in || !out)
+                    throw std::runtime_error("Context: cannot open " + input.string() + " or " + temporary.string());
+                strategy_->doStreamAlgorithm(in, out);
+                if (!out.flush())
+                    throw std::runtime_error("Context: failed to write " + temporary.string());
+            }
+            std::filesystem::rename(temporary, output);
+        }
+        catch (...) {
+            std::error_code ignored;
+            std::filesystem::remove(temporary, ignored);
+            throw;
+        }
+    }
 };
 
 /**
  * 具体策略在遵循基本策略界面的同时实现算法。该接口使它们在上下文中可互换。
  */
-class ConcreteStrategyA : public Strategy {
+class ConcreteStrategyA final : public Strategy {
 public:
     std::string doAlgorithm(std::string_view data) const override
     {
@@ -66,8 +136,14 @@ public:
 
         return result;
     }
+    void doAlgorithm(std::string_view data, std::string& out) const override
+    {
+        out.assign(data);
+        std::sort(std::begin(out), std::end(out));
+    }
 };
-class ConcreteStrategyB : public Strategy {
+class ConcreteStrategyB final : public Strategy {
+public:
     std::string doAlgorithm(std::string_view data) const override
     {
         std::string result(data);
@@ -75,6 +151,555 @@ class ConcreteStrategyB : public Strategy {
 
         return result;
     }
+    void doAlgorithm(std::string_view data, std::string& out) const override
+    {
+        out.assign(data);
+        std::sort(std::begin(out), std::end(out), std::greater<>());
+    }
+};
+
+/**
+ * 以下策略与 ConcreteStrategyA（升序）/ ConcreteStrategyB（降序）的结果逐字节相同。
+ * 注意 std::sort 比较的是 char，在 char 有符号的平台上 0x80-0xFF 排在 0x00 之前，这里保持同样的顺序。
+ */
+enum class SortOrder { Ascending, Descending };
+
+/**
+ * 计数排序：字母表只有 256 个字节值，统计直方图后按顺序回填即可，复杂度 O(n + 256)。
+ */
+class CountingSortStrategy : public Strategy {
+private:
+    SortOrder order_;
+
+public:
+    explicit CountingSortStrategy(SortOrder order = SortOrder::Ascending) : order_(order) {}
+
+    /**
+     * 用 4 张子直方图交替计数，连续相同字节不会卡在同一个计数器的读改写依赖上，循环也便于编译器展开/向量化。
+     */
+    static std::array<std::size_t, 256> Histogram(std::string_view data)
+    {
+        std::array<std::array<std::uint32_t, 256>, 4> partial{};
+        const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+        std::size_t n = data.size(), i = 0;
+        std::array<std::size_t, 256> counts{};
+        while (i < n) {
+            // 分块处理，保证 32 位子计数器不会溢出。
+            std::size_t end = i + std::min<std::size_t>(n - i, std::size_t(1) << 30);
+            for (; i + 4 <= end; i += 4) {
+                ++partial[0][bytes[i]];
+                ++partial[1][bytes[i + 1]];
+                ++partial[2][bytes[i + 2]];
+                ++partial[3][bytes[i + 3]];
+            }
+            for (; i < end; ++i) ++partial[0][bytes[i]];
+            for (std::size_t b = 0; b < 256; ++b) {
+                counts[b] += std::size_t(partial[0][b]) + partial[1][b] + partial[2][b] + partial[3][b];
+                partial[0][b] = partial[1][b] = partial[2][b] = partial[3][b] = 0;
+            }
+        }
+        return counts;
+    }
+
+    static void Fill(const std::array<std::size_t, 256>& counts, SortOrder order, char* out)
+    {
+        auto emit = [&](int value) {
+            std::size_t count = counts[static_cast<unsigned char>(value)];
+            std::memset(out, value, count);
+            out += count;
+        };
+        if (order == SortOrder::Ascending)
+            for (int value = CHAR_MIN; value <= CHAR_MAX; ++value) emit(value);
+        else
+            for (int value = CHAR_MAX; value >= CHAR_MIN; --value) emit(value);
+    }
+
+    std::string doAlgorithm(std::string_view data) const override
+    {
+        std::string result;
+        doAlgorithm(data, result);
+        return result;
+    }
+    void doAlgorithm(std::string_view data, std::string& out) const override
+    {
+        out.resize(data.size());
+        Fill(Histogram(data), order_, out.data());
+    }
+};
+
+/**
+ * 根据输入长度选择算法：很短时插入排序，中等长度用 std::sort，长输入用计数排序。
+ */
+class AdaptiveSortStrategy : public Strategy {
+private:
+    SortOrder order_;
+
+public:
+    static constexpr std::size_t kInsertionSortMax = 16;
+    static constexpr std::size_t kComparisonSortMax = 256;
+
+    explicit AdaptiveSortStrategy(SortOrder order = SortOrder::Ascending) : order_(order) {}
+
+    template <typename Compare>
+    static void InsertionSort(std::string& data, Compare compare)
+    {
+        for (std::size_t i = 1; i < data.size(); ++i) {
+            char value = data[i];
+            std::size_t j = i;
+            for (; j > 0 && compare(value, data[j - 1]); --j) data[j] = data[j - 1];
+            data[j] = value;
+        }
+    }
+
+    std::string doAlgorithm(std::string_view data) const override
+    {
+        std::string result;
+        doAlgorithm(data, result);
+        return result;
+    }
+    void doAlgorithm(std::string_view data, std::string& out) const override
+    {
+        if (data.size() > kComparisonSortMax) {
+            CountingSortStrategy(order_).doAlgorithm(data, out);
+            return;
+        }
+        out.assign(data);
+        if (data.size() <= kInsertionSortMax) {
+            if (order_ == SortOrder::Ascending)
+                InsertionSort(out, std::less<>());
+            else
+                InsertionSort(out, std::greater<>());
+        }
+        else if (order_ == SortOrder::Ascending) {
+            std::sort(std::begin(out), std::end(out));
+        }
+        else {
+            std::sort(std::begin(out), std::end(out), std::greater<>());
+        }
+    }
+};
+
+/**
+ * 简单的固定大小线程池，多个并行策略可以共享同一个池，避免每次调用都创建线程。
+ */
+class ThreadPool {
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::queue<std::function<void()>> tasks_;
+    std::vector<std::thread> workers_;
+    bool stop_ = false;
+
+    /**
+     * 当前线程所属的线程池，非工作线程为 nullptr。
+     */
+    static ThreadPool*& CurrentPool()
+    {
+        thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+public:
+    explicit ThreadPool(std::size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] {
+                CurrentPool() = this;
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        ready_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                        if (stop_ && tasks_.empty())
+                            return;
+                        task = std::move(tasks_.front());
+                        tasks_.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        ready_.notify_all();
+        for (std::thread& worker: workers_) worker.join();
+    }
+
+    /**
+     * 进程内共享的线程池，线程数等于硬件并发数。
+     */
+    static ThreadPool& Shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    std::size_t size() const
+    {
+        return workers_.size();
+    }
+
+    template <typename Fn>
+    std::future<void> Submit(Fn&& fn)
+    {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::forward<Fn>(fn));
+        std::future<void> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace([task] { (*task)(); });
+        }
+        ready_.notify_one();
+        return future;
+    }
+
+    /**
+     * 把 [0, count) 分成 parts 份并发执行 fn(part, begin, end)，等待全部完成。
+     * 任何一份抛出的异常都要等所有份结束后才重新抛出，因为它们引用着调用方栈上的 fn。
+     * 在本池的工作线程中调用时，各份在当前线程上依次执行，避免工作线程等待自己而死锁。
+     */
+    template <typename Fn>
+    void ParallelFor(std::size_t count, std::size_t parts, Fn fn)
+    {
+        if (CurrentPool() == this) {
+            for (std::size_t part = 0; part < parts; ++part) fn(part, count * part / parts, count * (part + 1) / parts);
+            return;
+        }
+        std::vector<std::future<void>> futures;
+        futures.reserve(parts);
+        try {
+            for (std::size_t part = 0; part < parts; ++part) {
+                std::size_t begin = count * part / parts, end = count * (part + 1) / parts;
+                futures.push_back(Submit([&fn, part, begin, end] { fn(part, begin, end); }));
+            }
+        }
+        catch (...) {
+            for (std::future<void>& future: futures) future.wait();
+            throw;
+        }
+        for (std::future<void>& future: futures) future.wait();
+        for (std::future<void>& future: futures) future.get();
+    }
+};
+
+/**
+ * 并行排序：把输入切成与线程数相同的块，各块并发统计直方图，合并直方图得到每个字节值的输出区间，
+ * 再把输出切块并发回填。输入小于阈值时退回串行的 AdaptiveSortStrategy。
+ *
+ * 字母表只有 256 个值，合并 P 张直方图只需 256 * P 次加法，比对已排序的块做多路归并便宜得多。
+ */
+class ParallelSortStrategy : public Strategy {
+private:
+    SortOrder order_;
+    ThreadPool& pool_;
+    std::size_t threshold_;
+
+public:
+    explicit ParallelSortStrategy(SortOrder order = SortOrder::Ascending, ThreadPool& pool = ThreadPool::Shared(),
+                                  std::size_t threshold = 1 << 20)
+        : order_(order), pool_(pool), threshold_(threshold)
+    {}
+
+    using Strategy::doAlgorithm;
+
+    std::string doAlgorithm(std::string_view data) const override
+    {
+        std::size_t parts = pool_.size();
+        if (data.size() < threshold_ || parts < 2)
+            return AdaptiveSortStrategy(order_).doAlgorithm(data);
+
+        std::vector<std::array<std::size_t, 256>> histograms(parts);
+        pool_.ParallelFor(data.size(), parts, [&](std::size_t part, std::size_t begin, std::size_t end) {
+            histograms[part] = CountingSortStrategy::Histogram(data.substr(begin, end - begin));
+        });
+
+        // 按输出顺序排列的 (字节值, 个数)。
+        std::vector<std::pair<char, std::size_t>> runs;
+        auto add_run = [&](int value) {
+            std::size_t count = 0;
+            for (const auto& histogram: histograms) count += histogram[static_cast<unsigned char>(value)];
+            if (count != 0)
+                runs.emplace_back(static_cast<char>(value), count);
+        };
+        if (order_ == SortOrder::Ascending)
+            for (int value = CHAR_MIN; value <= CHAR_MAX; ++value) add_run(value);
+        else
+            for (int value = CHAR_MAX; value >= CHAR_MIN; --value) add_run(value);
+
+        std::string result(data.size(), '\0');
+        pool_.ParallelFor(data.size(), parts, [&](std::size_t, std::size_t begin, std::size_t end) {
+            std::size_t offset = 0;
+            for (const auto& [value, count]: runs) {
+                std::size_t lo = std::max(offset, begin), hi = std::min(offset + count, end);
+                if (lo < hi)
+                    std::memset(&result[lo], value, hi - lo);
+                offset += count;
+                if (offset >= end)
+                    break;
+            }
+        });
+        return result;
+    }
+};
+
+/**
+ * 外部排序：输入可以远大于内存。按 memory_budget 大小的块流式读取输入，每一块排好序的“有序段”
+ * 对字节数据来说就是一张 256 项的直方图（游程编码），归并各段只需把直方图相加，
+ * 因而不必把有序段写到临时文件再做 k 路归并；输出同样按块生成和写出，峰值内存约为一个块。
+ */
+class ExternalSortStrategy : public Strategy {
+private:
+    SortOrder order_;
+    std::size_t memory_budget_;
+
+public:
+    explicit ExternalSortStrategy(SortOrder order = SortOrder::Ascending, std::size_t memory_budget = 64 << 20)
+        : order_(order), memory_budget_(std::max<std::size_t>(memory_budget, 4096))
+    {}
+
+    using Strategy::doAlgorithm;
+
+    std::string doAlgorithm(std::string_view data) const override
+    {
+        return CountingSortStrategy(order_).doAlgorithm(data);
+    }
+
+    void doStreamAlgorithm(std::istream& in, std::ostream& out) const override
+    {
+        std::vector<char> buffer(memory_budget_);
+        std::array<std::size_t, 256> counts{};
+        while (in) {
+            in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            std::size_t n = static_cast<std::size_t>(in.gcount());
+            if (n == 0)
+                break;
+            auto run = CountingSortStrategy::Histogram(std::string_view(buffer.data(), n));
+            for (std::size_t b = 0; b < 256; ++b) counts[b] += run[b];
+        }
+        if (in.bad())
+            throw std::runtime_error("ExternalSortStrategy: read error");
+
+        std::size_t used = 0;
+        auto emit = [&](int value) {
+            for (std::size_t count = counts[static_cast<unsigned char>(value)]; count > 0;) {
+                std::size_t n = std::min(count, buffer.size() - used);
+                std::memset(buffer.data() + used, value, n);
+                used += n;
+                count -= n;
+                if (used == buffer.size()) {
+                    out.write(buffer.data(), static_cast<std::streamsize>(used));
+                    used = 0;
+                }
+            }
+        };
+        if (order_ == SortOrder::Ascending)
+            for (int value = CHAR_MIN; value <= CHAR_MAX; ++value) emit(value);
+        else
+            for (int value = CHAR_MAX; value >= CHAR_MIN; --value) emit(value);
+        out.write(buffer.data(), static_cast<std::streamsize>(used));
+    }
+};
+
+/**
+ * 自动调优：启动时在合成数据上对每个候选策略按输入长度分桶（2 的幂）做微基准，记录每个桶的最快策略，
+ * 之后每次 doAlgorithm() 按输入长度路由到对应的策略。调优受总时间预算约束：按上一个桶的耗时预估，
+ * 放不进剩余预算的候选策略不再测量，一个候选都测不了的桶沿用上一个桶的结果。
+ * 结果可以缓存到 profile 文件，下次启动直接加载，无需重新测量。
+ *
+ * 所有候选策略必须产生相同的结果（例如同为升序），路由只影响速度。
+ */
+class AutotunedStrategy : public Strategy {
+public:
+    using Candidates = std::vector<std::pair<std::string, std::unique_ptr<Strategy>>>;
+    static constexpr std::size_t kBuckets = 25; // 1 字节到 16 MiB
+
+private:
+    Candidates candidates_;
+    std::array<std::size_t, kBuckets> winners_{};
+
+    static std::size_t Bucket(std::size_t size)
+    {
+        std::size_t bucket = 0;
+        while ((size >> bucket) > 1 && bucket + 1 < kBuckets) ++bucket;
+        return bucket;
+    }
+
+    /**
+     * 本机标识：CPU 型号（Linux 下取 /proc/cpuinfo 的 model name）加硬件线程数。
+     * 从另一台机器拷来的 profile 签名不同，会被丢弃并重新调优。
+     */
+    static std::string Machine()
+    {
+        std::string model = "unknown-cpu";
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        for (std::string line; std::getline(cpuinfo, line);) {
+            if (line.rfind("model name", 0) == 0 && line.find(':') != std::string::npos) {
+                model = line.substr(line.find(':') + 1);
+                model.erase(0, model.find_first_not_of(' '));
+                break;
+            }
+        }
+        return model + " x" + std::to_string(std::thread::hardware_concurrency());
+    }
+
+    std::string Signature() const
+    {
+        std::string signature = "strategy-autotune-v2 [" + Machine() + "]";
+        for (const auto& candidate: candidates_) signature += " " + candidate.first;
+        return signature;
+    }
+
+    bool Load(const std::filesystem::path& profile)
+    {
+        std::ifstream in(profile);
+        std::string signature;
+        if (!std::getline(in, signature) || signature != Signature())
+            return false;
+        std::array<std::size_t, kBuckets> winners{};
+        for (std::size_t& winner: winners) {
+            if (!(in >> winner) || winner >= candidates_.size())
+                return false;
+        }
+        winners_ = winners;
+        return true;
+    }
+
+    void Save(const std::filesystem::path& profile) const
+    {
+        std::ofstream out(profile, std::ios::trunc);
+        out << Signature() << "\n";
+        for (std::size_t winner: winners_) out << winner << "\n";
+    }
+
+    void Tune(std::chrono::steady_clock::duration budget)
+    {
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        // 每个桶内每个候选策略的测量时间片。
+        auto slice = budget / (kBuckets * std::max<std::size_t>(candidates_.size(), 1) * 2);
+        // 合成输入由一段 64 KiB 的随机字节重复而成，避免为大桶逐字节生成随机数占用预算。
+        std::mt19937 rng(1);
+        std::string pattern(64 * 1024, '\0');
+        for (char& c: pattern) c = static_cast<char>(rng());
+        std::string data;
+        // 每个候选策略在当前桶的预估单次耗时（秒）。每进入下一个桶输入长度翻倍，预估至少随之翻倍；
+        // 被跳过的候选不会再测量，但预估照样增长，不会停留在小桶上测得的数值。
+        std::vector<double> estimate(candidates_.size(), 0);
+        std::size_t previous = 0;
+        for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+            for (double& cost: estimate) cost *= 2;
+            double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+            // 留 25% 余量；没有候选放得进剩余预算时，连更大的合成输入也不必再生成，后面的桶沿用当前赢家。
+            if (*std::min_element(estimate.begin(), estimate.end()) * 1.25 > remaining) {
+                std::fill(winners_.begin() + bucket, winners_.end(), previous);
+                return;
+            }
+            std::size_t size = std::size_t(1) << bucket;
+            for (std::size_t offset = data.size(); offset < size; offset += pattern.size())
+                data.append(pattern, 0, std::min(pattern.size(), size - offset));
+            data.resize(size);
+            std::size_t winner = previous;
+            double best = -1;
+            for (std::size_t i = 0; i < candidates_.size(); ++i) {
+                remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+                if (estimate[i] * 1.25 > remaining)
+                    continue;
+                std::size_t runs = 0;
+                auto start = std::chrono::steady_clock::now();
+                auto elapsed = start - start;
+                do {
+                    candidates_[i].second->doAlgorithm(data);
+                    ++runs;
+                    elapsed = std::chrono::steady_clock::now() - start;
+                } while (elapsed < slice && start + elapsed < deadline);
+                estimate[i] = std::chrono::duration<double>(elapsed).count() / double(runs);
+                if (best < 0 || estimate[i] < best) {
+                    best = estimate[i];
+                    winner = i;
+                }
+            }
+            winners_[bucket] = previous = winner;
+        }
+    }
+
+public:
+    /**
+     * 若 profile 存在且与候选列表匹配则直接加载，否则在 budget 内调优并写回 profile（profile 为空路径时不缓存）。
+     */
+    AutotunedStrategy(Candidates candidates, const std::filesystem::path& profile,
+                      std::chrono::steady_clock::duration budget = std::chrono::milliseconds(500))
+        : candidates_(std::move(candidates))
+    {
+        if (candidates_.empty())
+            throw std::invalid_argument("AutotunedStrategy: no candidate strategies");
+        if (!profile.empty() && Load(profile))
+            return;
+        Tune(budget);
+        if (!profile.empty())
+            Save(profile);
+    }
+
+    const std::string& winner(std::size_t size) const
+    {
+        return candidates_[winners_[Bucket(size)]].first;
+    }
+
+    using Strategy::doAlgorithm;
+
+    std::string doAlgorithm(std::string_view data) const override
+    {
+        return candidates_[winners_[Bucket(data.size())]].second->doAlgorithm(data);
+    }
+};
+
+/**
+ * 不经过虚函数表的上下文。VariantContext 把若干具体策略按值放进 std::variant，用 std::visit 分派；
+ * StaticContext 在编译期就确定策略类型。两者都只提供输出到调用方缓冲区的接口，配合 final 的具体策略，
+ * 调用可以完全内联，也不会为每次调用分配新字符串。
+ */
+template <typename... Strategies>
+class VariantContext {
+private:
+    std::variant<Strategies...> strategy_;
+
+    /**
+     * S 是变体的某个备选策略。用来约束模板构造函数，使它不会抢在拷贝构造函数之前匹配 VariantContext 本身。
+     */
+    template <typename S>
+    static constexpr bool kIsStrategy = (std::is_same_v<std::decay_t<S>, Strategies> || ...);
+
+public:
+    template <typename S, typename = std::enable_if_t<kIsStrategy<S>>>
+    explicit VariantContext(S strategy) : strategy_(std::move(strategy))
+    {}
+
+    template <typename S, typename = std::enable_if_t<kIsStrategy<S>>>
+    void set_strategy(S strategy)
+    {
+        strategy_ = std::move(strategy);
+    }
+
+    void doAlgorithm(std::string_view data, std::string& out) const
+    {
+        std::visit([&](const auto& strategy) { strategy.doAlgorithm(data, out); }, strategy_);
+    }
+};
+
+template <typename S>
+class StaticContext {
+private:
+    S strategy_;
+
+public:
+    explicit StaticContext(S strategy = S()) : strategy_(std::move(strategy)) {}
+
+    void doAlgorithm(std::string_view data, std::string& out) const
+    {
+        strategy_.doAlgorithm(data, out);
+    }
 };
 
 /**
@@ -91,8 +716,181 @@ void clientCode()
     context.doSomeBusinessLogic();
 }
 
-int main()
+/**
+ * 对比 std::sort 与计数排序/自适应策略在不同输入长度下的耗时，并校验结果逐字节一致。
+ */
+void benchmarkSortStrategies()
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> byte(0, 255);
+    const std::pair<const char*, SortOrder> orders[] = {{"A (ascending) ", SortOrder::Ascending},
+                                                        {"B (descending)", SortOrder::Descending}};
+    for (auto [name, order]: orders) {
+        std::unique_ptr<Strategy> reference;
+        if (order == SortOrder::Ascending)
+            reference = std::make_unique<ConcreteStrategyA>();
+        else
+            reference = std::make_unique<ConcreteStrategyB>();
+        CountingSortStrategy counting(order);
+        AdaptiveSortStrategy adaptive(order);
+        for (std::size_t size: {8, 64, 1024, 65536, 1 << 22}) {
+            std::string data(size, '\0');
+            for (char& c: data) c = static_cast<char>(byte(rng));
+            std::size_t repeat = std::max<std::size_t>(1, (1 << 20) / size);
+
+            auto time = [&](const Strategy& strategy, std::string& result) {
+                auto start = std::chrono::steady_clock::now();
+                for (std::size_t r = 0; r < repeat; ++r) result = strategy.doAlgorithm(data);
+                return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                       double(repeat);
+            };
+            std::string expected, actual_counting, actual_adaptive;
+            double sort_ns = time(*reference, expected);
+            double counting_ns = time(counting, actual_counting);
+            double adaptive_ns = time(adaptive, actual_adaptive);
+            bool identical = expected == actual_counting && expected == actual_adaptive;
+            std::cout << name << " n=" << size << ": std::sort " << sort_ns << " ns, counting " << counting_ns
+                      << " ns, adaptive " << adaptive_ns << " ns, speedup " << sort_ns / counting_ns
+                      << "x, identical " << std::boolalpha << identical << "\n";
+        }
+    }
+}
+
+/**
+ * 对多 MB 输入，报告并行策略从 1 个到 N 个线程的加速比。
+ */
+void benchmarkParallelSort(std::size_t size = 64 << 20)
+{
+    std::string data(size, '\0');
+    std::mt19937 rng(7);
+    for (char& c: data) c = static_cast<char>(rng());
+    std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (SortOrder order: {SortOrder::Ascending, SortOrder::Descending}) {
+        std::string expected = AdaptiveSortStrategy(order).doAlgorithm(data);
+        double serial_ms = 0;
+        std::vector<std::size_t> thread_counts;
+        for (std::size_t threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+        thread_counts.push_back(max_threads);
+        for (std::size_t threads: thread_counts) {
+            ThreadPool pool(threads);
+            // 1 个线程即串行路径，作为加速比的基准。
+            ParallelSortStrategy strategy(order, pool);
+            auto start = std::chrono::steady_clock::now();
+            std::string result = strategy.doAlgorithm(data);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (threads == 1)
+                serial_ms = ms;
+            std::cout << (order == SortOrder::Ascending ? "A" : "B") << " parallel n=" << size << " threads " << threads
+                      << ": " << ms << " ms, speedup " << serial_ms / ms << "x, identical " << std::boolalpha
+                      << (result == expected) << "\n";
+        }
+    }
+}
+
+/**
+ * 在数倍于内存预算的文件上测量外部排序吞吐量。
+ */
+void benchmarkExternalSort(std::size_t memory_budget = 16 << 20, std::size_t file_size = 128 << 20)
 {
+    std::filesystem::path input = std::filesystem::temp_directory_path() / "strategy-external-in.bin";
+    std::filesystem::path output = std::filesystem::temp_directory_path() / "strategy-external-out.bin";
+    std::string data(file_size, '\0');
+    std::mt19937 rng(11);
+    for (char& c: data) c = static_cast<char>(rng());
+    std::ofstream(input, std::ios::binary).write(data.data(), static_cast<std::streamsize>(data.size()));
+
+    for (SortOrder order: {SortOrder::Ascending, SortOrder::Descending}) {
+        Context context(std::make_unique<ExternalSortStrategy>(order, memory_budget));
+        auto start = std::chrono::steady_clock::now();
+        context.doSomeBusinessLogic(input, output);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::ifstream in(output, std::ios::binary);
+        std::string result(std::istreambuf_iterator<char>(in), {});
+        std::cout << (order == SortOrder::Ascending ? "A" : "B") << " external n=" << file_size << " budget "
+                  << memory_budget << ": " << file_size / seconds / (1 << 20) << " MiB/s, identical " << std::boolalpha
+                  << (result == CountingSortStrategy(order).doAlgorithm(data)) << "\n";
+    }
+    std::filesystem::remove(input);
+    std::filesystem::remove(output);
+}
+
+/**
+ * 首次启动在时间预算内调优，第二次启动从缓存的 profile 加载。
+ */
+void benchmarkAutotune()
+{
+    auto candidates = [] {
+        AutotunedStrategy::Candidates candidates;
+        candidates.emplace_back("std::sort", std::make_unique<ConcreteStrategyA>());
+        candidates.emplace_back("counting", std::make_unique<CountingSortStrategy>());
+        candidates.emplace_back("adaptive", std::make_unique<AdaptiveSortStrategy>());
+        candidates.emplace_back("parallel", std::make_unique<ParallelSortStrategy>());
+        return candidates;
+    };
+    std::filesystem::path profile = std::filesystem::temp_directory_path() / "strategy-autotune.profile";
+    std::filesystem::remove(profile);
+    for (const char* run: {"cold start (tuning)", "warm start (cached)"}) {
+        auto start = std::chrono::steady_clock::now();
+        AutotunedStrategy strategy(candidates(), profile, std::chrono::milliseconds(500));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "autotune " << run << ": " << ms << " ms; winners:";
+        for (std::size_t size: {1, 16, 256, 4096, 65536, 1 << 20, 1 << 24})
+            std::cout << " " << size << "=" << strategy.winner(size);
+        std::cout << "\n";
+    }
+    std::filesystem::remove(profile);
+}
+
+/**
+ * 数百万次小输入调用：虚函数 + 每次返回新字符串、虚函数 + 复用缓冲区、variant 分派、模板分派。
+ */
+void benchmarkDispatch(std::size_t calls = 4000000)
+{
+    std::mt19937 rng(3);
+    std::vector<std::string> inputs(64);
+    for (std::string& input: inputs) {
+        input.resize(32);
+        for (char& c: input) c = static_cast<char>('a' + rng() % 26);
+    }
+    auto run = [&](const char* name, auto&& call) {
+        std::size_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < calls; ++i) checksum += static_cast<unsigned char>(call(inputs[i & 63]));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << name << ": " << calls / seconds / 1e6 << " M calls/s (checksum " << checksum << ")\n";
+    };
+
+    std::unique_ptr<Strategy> strategy = std::make_unique<ConcreteStrategyA>();
+    const Strategy& virtual_strategy = *strategy;
+    VariantContext<ConcreteStrategyA, ConcreteStrategyB> variant_context(ConcreteStrategyA{});
+    StaticContext<ConcreteStrategyA> static_context;
+    std::string out;
+    run("virtual, new string ", [&](std::string_view data) { return virtual_strategy.doAlgorithm(data)[0]; });
+    run("virtual, reused out ", [&](std::string_view data) {
+        virtual_strategy.doAlgorithm(data, out);
+        return out[0];
+    });
+    run("variant, reused out ", [&](std::string_view data) {
+        variant_context.doAlgorithm(data, out);
+        return out[0];
+    });
+    run("template, reused out", [&](std::string_view data) {
+        static_context.doAlgorithm(data, out);
+        return out[0];
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        benchmarkSortStrategies();
+        benchmarkParallelSort();
+        benchmarkExternalSort();
+        benchmarkAutotune();
+        benchmarkDispatch();
+        return 0;
+    }
     clientCode();
     return 0;
 }
\ No newline at end of file
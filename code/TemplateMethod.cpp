@@ -1,8 +1,311 @@
 //
 // Created by Listening on 2023/4/6.
 // 模板方法
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 模板方法的逐步性能剖析，默认关闭：此时 TEMPLATE_METHOD_STEP 只展开成原来的调用，剖析相关的类也不会被编译。
+ * 编译时定义 TEMPLATE_METHOD_PROFILING=1 开启插桩（见 TemplateMethodProfiled 目标）。
+ */
+#ifndef TEMPLATE_METHOD_PROFILING
+#define TEMPLATE_METHOD_PROFILING 0
+#endif
+
+#if TEMPLATE_METHOD_PROFILING
+#include <typeindex>
+#include <unordered_map>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <x86intrin.h>
+#endif
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+/**
+ * 廉价的时间戳：x86-64 上读 TSC，其他平台退回 steady_clock。换算成纳秒的比例只在第一次使用时校准一次。
+ */
+class StepClock {
+public:
+    static std::uint64_t Now()
+    {
+#if defined(__x86_64__) && defined(__GNUC__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+    static double NanosecondsPerTick()
+    {
+#if defined(__x86_64__) && defined(__GNUC__)
+        static const double ratio = [] {
+            auto wall_start = std::chrono::steady_clock::now();
+            std::uint64_t tick_start = Now();
+            while (std::chrono::steady_clock::now() - wall_start < std::chrono::milliseconds(20)) {
+            }
+            std::chrono::duration<double, std::nano> wall = std::chrono::steady_clock::now() - wall_start;
+            return wall.count() / double(Now() - tick_start);
+        }();
+        return ratio;
+#else
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::duration(1)).count();
+#endif
+    }
+};
+
+/**
+ * 按具体类聚合每一步的耗时，并保留每个线程最早的一批事件用于导出 Chrome trace-event JSON（chrome://tracing、Perfetto 可直接打开）。
+ * 每个线程写自己的缓冲区，记录路径上没有锁；Report() 和 WriteChromeTrace() 应在记录线程停下之后调用。
+ */
+class StepProfiler {
+public:
+    enum Step : std::uint8_t {
+        kTemplateMethod,
+        kBaseOperation1,
+        kRequiredOperations1,
+        kBaseOperation2,
+        kHook1,
+        kRequiredOperation2,
+        kBaseOperation3,
+        kHook2,
+        kStepCount
+    };
+    static constexpr const char* kStepNames[kStepCount] = {
+        "TemplateMethod", "BaseOperation1",     "RequiredOperations1", "BaseOperation2",
+        "Hook1",          "RequiredOperation2", "BaseOperation3",      "Hook2"};
+    static constexpr std::size_t kMaxEventsPerThread = 1 << 16;
+
+private:
+    struct Event {
+        std::uint64_t start;
+        std::uint64_t end;
+        std::uint32_t class_id;
+        Step step;
+    };
+    struct Stats {
+        std::uint64_t count = 0;
+        std::uint64_t total = 0;
+        std::uint64_t min = UINT64_MAX;
+        std::uint64_t max = 0;
+    };
+    struct ThreadBuffer {
+        std::uint32_t tid;
+        std::vector<Event> events;
+        std::vector<Stats> stats;
+        std::uint64_t dropped = 0;
+    };
+
+    std::mutex mutex_;
+    std::unordered_map<std::type_index, std::uint32_t> class_ids_;
+    std::vector<std::string> class_names_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+
+    ThreadBuffer& Buffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffers_.push_back(std::make_unique<ThreadBuffer>());
+            buffer = buffers_.back().get();
+            buffer->tid = static_cast<std::uint32_t>(buffers_.size());
+            buffer->events.reserve(kMaxEventsPerThread);
+        }
+        return *buffer;
+    }
+
+    static std::string Demangle(const char* name)
+    {
+#if defined(__GNUC__)
+        int status = 0;
+        std::unique_ptr<char, void (*)(void*)> demangled(abi::__cxa_demangle(name, nullptr, nullptr, &status),
+                                                         std::free);
+        if (status == 0)
+            return demangled.get();
+#endif
+        return name;
+    }
+
+public:
+    static StepProfiler& Instance()
+    {
+        static StepProfiler profiler;
+        return profiler;
+    }
+
+    /**
+     * 把具体类映射成紧凑的编号。同一线程连续处理同一个类时直接命中缓存，不加锁。
+     * 未命中时顺便准备好本线程的缓冲区，避免第一次记录的分配落在被计时的区间里。
+     */
+    std::uint32_t ClassId(const std::type_info& type)
+    {
+        thread_local const std::type_info* last_type = nullptr;
+        thread_local std::uint32_t last_id = 0;
+        if (last_type == &type)
+            return last_id;
+        ThreadBuffer& buffer = Buffer();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto inserted = class_ids_.emplace(type, static_cast<std::uint32_t>(class_names_.size()));
+            if (inserted.second)
+                class_names_.push_back(Demangle(type.name()));
+            last_type = &type;
+            last_id = inserted.first->second;
+        }
+        if (buffer.stats.size() < (std::size_t(last_id) + 1) * kStepCount)
+            buffer.stats.resize((std::size_t(last_id) + 1) * kStepCount);
+        return last_id;
+    }
+
+    void Record(std::uint32_t class_id, Step step, std::uint64_t start, std::uint64_t end)
+    {
+        ThreadBuffer& buffer = Buffer();
+        std::size_t slot = std::size_t(class_id) * kStepCount + step;
+        if (slot >= buffer.stats.size())
+            buffer.stats.resize((std::size_t(class_id) + 1) * kStepCount);
+        Stats& stats = buffer.stats[slot];
+        std::uint64_t ticks = end - start;
+        ++stats.count;
+        stats.total += ticks;
+        stats.min = std::min(stats.min, ticks);
+        stats.max = std::max(stats.max, ticks);
+        if (buffer.events.size() < kMaxEventsPerThread)
+            buffer.events.push_back(Event{start, end, class_id, step});
+        else
+            ++buffer.dropped;
+    }
+
+    /**
+     * 按具体类打印每一步的调用次数、平均、最小、最大耗时（纳秒）。
+     */
+    void Report(std::ostream& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double scale = StepClock::NanosecondsPerTick();
+        for (std::uint32_t class_id = 0; class_id < class_names_.size(); ++class_id) {
+            out << class_names_[class_id] << ":\n";
+            for (int step = 0; step < kStepCount; ++step) {
+                Stats merged;
+                for (const auto& buffer: buffers_) {
+                    std::size_t slot = std::size_t(class_id) * kStepCount + step;
+                    if (slot >= buffer->stats.size())
+                        continue;
+                    const Stats& stats = buffer->stats[slot];
+                    merged.count += stats.count;
+                    merged.total += stats.total;
+                    merged.min = std::min(merged.min, stats.min);
+                    merged.max = std::max(merged.max, stats.max);
+                }
+                if (merged.count == 0)
+                    continue;
+                out << "  " << std::left << std::setw(20) << kStepNames[step] << std::right << std::fixed
+                    << std::setprecision(1) << " calls " << std::setw(8) << merged.count << "  avg " << std::setw(9)
+                    << merged.total * scale / merged.count << " ns  min " << std::setw(9) << merged.min * scale
+                    << " ns  max " << std::setw(9) << merged.max * scale << " ns\n";
+            }
+        }
+        out << std::defaultfloat << std::setprecision(6);
+    }
+
+    /**
+     * 导出为 Chrome trace-event 格式的完整事件（ph = "X"），时间单位为微秒。
+     * 每个线程最多保留 kMaxEventsPerThread 个事件，超出的部分只计入聚合统计。
+     */
+    void WriteChromeTrace(std::ostream& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double scale = StepClock::NanosecondsPerTick() / 1000.0;
+        std::uint64_t origin = UINT64_MAX;
+        for (const auto& buffer: buffers_) {
+            for (const Event& event: buffer->events) origin = std::min(origin, event.start);
+        }
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (const auto& buffer: buffers_) {
+            for (const Event& event: buffer->events) {
+                out << (first ? "\n" : ",\n") << "{\"name\":\"" << kStepNames[event.step] << "\",\"cat\":\""
+                    << class_names_[event.class_id] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                    << ",\"ts\":" << (event.start - origin) * scale << ",\"dur\":" << (event.end - event.start) * scale
+                    << "}";
+                first = false;
+            }
+        }
+        out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    }
+
+    std::uint64_t Dropped()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::uint64_t dropped = 0;
+        for (const auto& buffer: buffers_) dropped += buffer->dropped;
+        return dropped;
+    }
+
+    void Reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& buffer: buffers_) {
+            buffer->events.clear();
+            buffer->stats.assign(buffer->stats.size(), Stats{});
+            buffer->dropped = 0;
+        }
+    }
+};
+
+/**
+ * 一次模板方法调用的计时器。相邻步骤共用时间戳：上一步的结束就是下一步的开始，
+ * 所以 n 个步骤只读 n + 1 次时钟（上一步的记账开销会计入下一步，只有几纳秒）。
+ * 析构时把从开始到最后一步结束的整段时间记为 TemplateMethod。
+ */
+class StepTimer {
+private:
+    StepProfiler& profiler_;
+    std::uint32_t class_id_;
+    std::uint64_t start_;
+    std::uint64_t last_;
+
+public:
+    explicit StepTimer(const std::type_info& type)
+        : profiler_(StepProfiler::Instance()), class_id_(profiler_.ClassId(type)), start_(StepClock::Now()),
+          last_(start_)
+    {
+    }
+    ~StepTimer()
+    {
+        profiler_.Record(class_id_, StepProfiler::kTemplateMethod, start_, last_);
+    }
+    StepTimer(const StepTimer&) = delete;
+    StepTimer& operator=(const StepTimer&) = delete;
+
+    void Mark(StepProfiler::Step step)
+    {
+        std::uint64_t now = StepClock::Now();
+        profiler_.Record(class_id_, step, last_, now);
+        last_ = now;
+    }
+};
+
+#define TEMPLATE_METHOD_PROFILE_BEGIN() StepTimer template_method_timer_(typeid(*this))
+#define TEMPLATE_METHOD_STEP(step, call)                                                                               \
+    do {                                                                                                               \
+        call;                                                                                                          \
+        template_method_timer_.Mark(StepProfiler::step);                                                               \
+    } while (0)
+#else
+#define TEMPLATE_METHOD_PROFILE_BEGIN() static_cast<void>(0)
+#define TEMPLATE_METHOD_STEP(step, call) call
+#endif
 
 /**
  * 抽象类定义了一个模板方法，该方法包含某种算法的框架，由对（通常）抽象基元操作的调用组成。
@@ -15,14 +318,30 @@ class AbstractClass {
 public:
     void TemplateMethod() const
     {
-        this->BaseOperation1();
-        this->RequiredOperations1();
-        this->BaseOperation2();
-        this->Hook1();
-        this->RequiredOperation2();
-        this->BaseOperation3();
-        this->Hook2();
+        TEMPLATE_METHOD_PROFILE_BEGIN();
+        TEMPLATE_METHOD_STEP(kBaseOperation1, this->BaseOperation1());
+        TEMPLATE_METHOD_STEP(kRequiredOperations1, this->RequiredOperations1());
+        TEMPLATE_METHOD_STEP(kBaseOperation2, this->BaseOperation2());
+        TEMPLATE_METHOD_STEP(kHook1, this->Hook1());
+        TEMPLATE_METHOD_STEP(kRequiredOperation2, this->RequiredOperation2());
+        TEMPLATE_METHOD_STEP(kBaseOperation3, this->BaseOperation3());
+        TEMPLATE_METHOD_STEP(kHook2, this->Hook2());
     }
+
+    using Step = void (AbstractClass::*)() const;
+    static constexpr std::size_t kStepCount = 7;
+    /**
+     * 与 TemplateMethod() 相同的步骤顺序，流水线模式为其中每一步建立一个阶段。
+     */
+    static const std::array<Step, kStepCount>& Steps()
+    {
+        static const std::array<Step, kStepCount> steps = {
+            &AbstractClass::BaseOperation1, &AbstractClass::RequiredOperations1, &AbstractClass::BaseOperation2,
+            &AbstractClass::Hook1,          &AbstractClass::RequiredOperation2,  &AbstractClass::BaseOperation3,
+            &AbstractClass::Hook2};
+        return steps;
+    }
+    virtual ~AbstractClass() = default;
     /**
      * 这些操作已经实现。
      */
@@ -82,6 +401,157 @@ protected:
         std::cout << "ConcreteClass2 says: Overridden Hook1\n";
     }
 };
+/**
+ * 有界的单生产者单消费者无锁环形队列，容量为 2 的幂。TryPush/TryPop 不加锁；Push/Pop 在队列满/空时
+ * 阻塞在条件变量上而不是空转，另一端只有在确实有线程等待时才加锁唤醒。
+ */
+template <typename T>
+class SpscRing {
+private:
+    std::vector<T> slots_;
+    std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) std::atomic<int> waiters_{0};
+    static constexpr int kSpins = 16;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+
+    /**
+     * 入队/出队之后调用。两端的 seq_cst 栅栏保证：要么这里看到等待者并加锁通知，
+     * 要么等待者登记后重新检查时看到了刚才的修改，不会丢失唤醒。
+     */
+    void Wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) == 0)
+            return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        changed_.notify_all();
+    }
+    /**
+     * 先让出处理器重试有限几次（另一端通常很快就会跟上），仍不成功再登记为等待者并阻塞。
+     */
+    template <typename Try>
+    void Wait(Try&& attempt)
+    {
+        for (int spin = 0; spin < kSpins; ++spin) {
+            std::this_thread::yield();
+            if (attempt())
+                return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        changed_.wait(lock, attempt);
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+public:
+    explicit SpscRing(std::size_t capacity)
+    {
+        std::size_t size = 1;
+        while (size < capacity) size <<= 1;
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    bool TryPush(const T& value)
+    {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == slots_.size())
+            return false;
+        slots_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& value)
+    {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        value = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void Push(const T& value)
+    {
+        if (!TryPush(value))
+            Wait([&] { return TryPush(value); });
+        Wake();
+    }
+
+    T Pop()
+    {
+        T value;
+        if (!TryPop(value))
+            Wait([&] { return TryPop(value); });
+        Wake();
+        return value;
+    }
+};
+
+/**
+ * 流水线模式：模板方法的每一步是一个阶段，各阶段在自己的线程上运行，阶段之间用有界无锁队列连接。
+ * 不同的对象可以同时处于不同的步骤，但每个对象仍按 TemplateMethod() 的顺序依次经过所有步骤，
+ * 对象的先后次序也保持不变。某一步抛出异常后，后续对象不再执行任何步骤，异常在 Run() 返回前重新抛出。
+ */
+class TemplateMethodPipeline {
+private:
+    std::size_t queue_capacity_;
+
+public:
+    explicit TemplateMethodPipeline(std::size_t queue_capacity = 256) : queue_capacity_(queue_capacity) {}
+
+    void Run(const std::vector<const AbstractClass*>& items) const
+    {
+        const auto& steps = AbstractClass::Steps();
+        std::vector<std::unique_ptr<SpscRing<const AbstractClass*>>> queues;
+        for (std::size_t i = 1; i < steps.size(); ++i)
+            queues.push_back(std::make_unique<SpscRing<const AbstractClass*>>(queue_capacity_));
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+
+        auto execute = [&](const AbstractClass* item, AbstractClass::Step step) {
+            if (failed.load(std::memory_order_relaxed))
+                return;
+            try {
+                (item->*step)();
+            }
+            catch (...) {
+                if (!failed.exchange(true))
+                    error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> stages;
+        for (std::size_t stage = 1; stage < steps.size(); ++stage) {
+            stages.emplace_back([&, stage] {
+                SpscRing<const AbstractClass*>& input = *queues[stage - 1];
+                SpscRing<const AbstractClass*>* output = stage < queues.size() ? queues[stage].get() : nullptr;
+                // nullptr 表示输入结束
+                for (const AbstractClass* item = input.Pop(); item; item = input.Pop()) {
+                    execute(item, steps[stage]);
+                    if (output)
+                        output->Push(item);
+                }
+                if (output)
+                    output->Push(nullptr);
+            });
+        }
+        for (const AbstractClass* item: items) {
+            execute(item, steps[0]);
+            queues[0]->Push(item);
+        }
+        queues[0]->Push(nullptr);
+        for (std::thread& stage: stages) stage.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
 /**
  * 客户端代码调用模板方法来执行算法。客户端代码不必知道它所处理的对象的具体类，只要它通过其基类的接口处理对象即可。
  */
@@ -92,8 +562,118 @@ void ClientCode(AbstractClass* class_)
     // ...
 }
 
-int main()
+/**
+ * 测量一次模板方法调用的耗时。输出被丢弃，各步骤几乎不做事，所以差值基本就是插桩开销。
+ * 与定义了 TEMPLATE_METHOD_PROFILING=1 的 TemplateMethodProfiled 比较即可得到开启与关闭时的开销。
+ */
+void BenchmarkProfilerOverhead()
 {
+    constexpr int kCalls = 1000000;
+    ConcreteClass2 concrete;
+    std::streambuf* console = std::cout.rdbuf(nullptr);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kCalls; ++i) concrete.TemplateMethod();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout.rdbuf(console);
+    std::cout.clear();
+    std::cout << "profiling " << (TEMPLATE_METHOD_PROFILING ? "on " : "off") << ": " << elapsed.count() / kCalls
+              << " ns per TemplateMethod() call\n";
+}
+
+/**
+ * 丢弃所有输出的流缓冲区，无状态，可以被多个线程同时写入。
+ */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+};
+
+/**
+ * 步骤耗时不均匀的具体类。每一步都以不满足交换律的方式更新 state_，所以步骤顺序错了结果就会不同。
+ */
+class UnevenClass : public AbstractClass {
+private:
+    mutable std::uint64_t state_;
+
+    void Work(std::uint64_t step, int iterations) const
+    {
+        std::uint64_t state = state_ * 31 + step;
+        for (int i = 0; i < iterations; ++i) state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        state_ = state;
+    }
+
+protected:
+    void RequiredOperations1() const override
+    {
+        Work(1, 4000);
+    }
+    void RequiredOperation2() const override
+    {
+        Work(2, 2000);
+    }
+    void Hook1() const override
+    {
+        Work(3, 500);
+    }
+    void Hook2() const override
+    {
+        Work(4, 1000);
+    }
+
+public:
+    explicit UnevenClass(std::uint64_t seed) : state_(seed) {}
+    std::uint64_t State() const
+    {
+        return state_;
+    }
+};
+
+/**
+ * 比较逐个对象串行执行模板方法与流水线模式的吞吐量，并检查两者结果一致。
+ * 流水线的吞吐量受最慢的阶段限制：这里 RequiredOperations1 约占总耗时的一半，所以核数足够时最多约快 2 倍。
+ */
+void BenchmarkPipeline()
+{
+    constexpr std::size_t kItems = 20000;
+    NullBuffer null_buffer;
+    std::streambuf* console = std::cout.rdbuf(&null_buffer);
+
+    std::vector<std::unique_ptr<UnevenClass>> serial_items, pipeline_items;
+    std::vector<const AbstractClass*> pipeline_view;
+    for (std::size_t i = 0; i < kItems; ++i) {
+        serial_items.push_back(std::make_unique<UnevenClass>(i));
+        pipeline_items.push_back(std::make_unique<UnevenClass>(i));
+        pipeline_view.push_back(pipeline_items.back().get());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& item: serial_items) item->TemplateMethod();
+    std::chrono::duration<double> serial = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    TemplateMethodPipeline().Run(pipeline_view);
+    std::chrono::duration<double> pipelined = std::chrono::steady_clock::now() - start;
+
+    bool identical = true;
+    for (std::size_t i = 0; i < kItems; ++i) identical &= serial_items[i]->State() == pipeline_items[i]->State();
+    std::cout.rdbuf(console);
+    std::cout << "hardware threads " << std::thread::hardware_concurrency() << "\n";
+    std::cout << "serial   " << kItems / serial.count() / 1e3 << " k items/s\n";
+    std::cout << "pipeline " << kItems / pipelined.count() / 1e3 << " k items/s (" << AbstractClass::kStepCount
+              << " stages), identical results " << std::boolalpha << identical << "\n";
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        BenchmarkProfilerOverhead();
+        BenchmarkPipeline();
+        return 0;
+    }
+
     std::cout << "Same client code can work with different subclasses:\n";
     std::unique_ptr<ConcreteClass1> concreteClass1 = std::make_unique<ConcreteClass1>();
     ClientCode(concreteClass1.get());
@@ -103,5 +683,26 @@ int main()
     std::unique_ptr<ConcreteClass2> concreteClass2 = std::make_unique<ConcreteClass2>();
     ClientCode(concreteClass2.get());
 
+    std::cout << "\n";
+    std::cout << "The same steps can run as a pipeline over a stream of objects:\n";
+    // 各阶段在不同线程上同时打印，输出会交错，所以流水线运行期间丢弃输出，结束后再汇报。
+    {
+        NullBuffer null_buffer;
+        std::streambuf* console = std::cout.rdbuf(&null_buffer);
+        TemplateMethodPipeline().Run({concreteClass1.get(), concreteClass2.get()});
+        std::cout.rdbuf(console);
+    }
+    std::cout << "Pipeline ran 2 objects through " << AbstractClass::kStepCount << " stages\n";
+
+#if TEMPLATE_METHOD_PROFILING
+    std::cout << "\nPer-step timings:\n";
+    StepProfiler::Instance().Report(std::cout);
+    if (argc > 2 && std::string(argv[1]) == "trace") {
+        std::ofstream trace(argv[2]);
+        StepProfiler::Instance().WriteChromeTrace(trace);
+        std::cout << "Chrome trace written to " << argv[2] << "\n";
+    }
+#endif
+
     return 0;
 }
\ No newline at end of file